@@ -39,6 +39,7 @@ WLM_API struct wlm_display *wlm_display_create(void);
 WLM_API bool wlm_display_connect(struct wlm_display *display, char const *name);
 WLM_API void wlm_display_destroy(struct wlm_display *display);
 WLM_API int wlm_display_dispatch(struct wlm_display *display);
+WLM_API void wlm_display_flush(struct wlm_display *display);
 
 WLM_API struct wl_cursor *wlm_display_get_cursor(struct wlm_display *display,
                                                  char const *theme_name,
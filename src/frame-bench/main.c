@@ -0,0 +1,284 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include <cairo.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client.h>
+
+#include <wlmatchapp/display.h>
+#include <wlmatchapp/toplevel.h>
+
+#define DISPLAY_PREFIX "Display is "
+
+static struct option options[] = {
+    {"compositor", required_argument, NULL, 'c'},
+    {"outputs", required_argument, NULL, 'o'},
+    {"clients", required_argument, NULL, 'n'},
+    {"rate", required_argument, NULL, 'r'},
+    {"duration", required_argument, NULL, 'd'},
+    {NULL},
+};
+
+struct client {
+  struct wlm_toplevel *toplevel;
+  uint32_t frame;
+  uint64_t commits;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_terminate(int signal) { running = 0; }
+
+static void window_configure(struct wlm_window *window, uint32_t serial) {
+  struct client *c = wlm_window_get_user_data(window);
+  wlm_window_set_size(window, c->toplevel->configure.width,
+                      c->toplevel->configure.height);
+}
+
+static void window_draw(struct wlm_window *window, cairo_t *cr) {
+  struct client *c = wlm_window_get_user_data(window);
+  double shade = (c->frame++ % 256) / 255.0;
+
+  /* Change the whole window every frame so every commit damages it all */
+  cairo_set_source_rgb(cr, shade, 0.5, 1.0 - shade);
+  cairo_paint(cr);
+  c->commits++;
+}
+
+static int run_client(char const *display_name, int index, unsigned int rate) {
+  struct sigaction sa = {.sa_handler = handle_terminate};
+  sigaction(SIGTERM, &sa, NULL);
+
+  struct wlm_display *display = wlm_display_create();
+  if (!wlm_display_connect(display, display_name)) {
+    fprintf(stderr, "Client %d unable to connect to %s\n", index,
+            display_name);
+    wlm_display_destroy(display);
+    return 1;
+  }
+
+  struct client c = {0};
+  c.toplevel = wlm_toplevel_create(display);
+  wlm_toplevel_set_user_data(c.toplevel, &c);
+  wlm_toplevel_set_app_id(c.toplevel,
+                          "org.openembedded.wlmatchbox-frame-bench");
+  wlm_toplevel_set_title(c.toplevel, "Frame Benchmark");
+  c.toplevel->base.on_draw = window_draw;
+  c.toplevel->base.on_configure = window_configure;
+
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  long period = 1000000000L / rate;
+  struct itimerspec spec = {
+      .it_interval = {period / 1000000000L, period % 1000000000L},
+      .it_value = {period / 1000000000L, period % 1000000000L},
+  };
+  timerfd_settime(timer, 0, &spec, NULL);
+
+  while (running) {
+    wl_display_dispatch_pending(display->display);
+    wlm_display_flush(display);
+
+    struct pollfd fds[] = {
+        {.fd = wl_display_get_fd(display->display), .events = POLLIN},
+        {.fd = timer, .events = POLLIN},
+    };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      if (wl_display_dispatch(display->display) == -1) {
+        break;
+      }
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t expirations;
+      if (read(timer, &expirations, sizeof(expirations)) > 0) {
+        wlm_window_schedule_redraw(&c.toplevel->base);
+      }
+    }
+  }
+
+  printf("client %d: %" PRIu64 " commits\n", index, c.commits);
+  fflush(stdout);
+
+  close(timer);
+  wlm_toplevel_destroy(c.toplevel);
+  wlm_display_destroy(display);
+  return 0;
+}
+
+static pid_t start_compositor(char const *compositor, FILE **out) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC)) {
+    perror("Unable to create pipe");
+    return -1;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    execl(compositor, compositor, "--frame-stats", NULL);
+    perror("Unable to execute compositor");
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    perror("Unable to fork");
+    close(fds[0]);
+    return -1;
+  }
+
+  *out = fdopen(fds[0], "r");
+  return pid;
+}
+
+static char *read_display_name(FILE *out) {
+  char *line = NULL;
+  size_t len = 0;
+  while (getline(&line, &len, out) != -1) {
+    if (strncmp(line, DISPLAY_PREFIX, strlen(DISPLAY_PREFIX)) == 0) {
+      char *name = strdup(line + strlen(DISPLAY_PREFIX));
+      name[strcspn(name, "\n")] = '\0';
+      free(line);
+      return name;
+    }
+    fputs(line, stdout);
+  }
+  free(line);
+  return NULL;
+}
+
+static void usage(char const *name) {
+  printf("Usage: %s -c|--compositor PATH [OPTIONS]\n", name);
+  printf("\n");
+  printf("  -c|--compositor PATH  wlmatchbox executable to benchmark\n");
+  printf("  -o|--outputs N        Number of headless outputs (default 1)\n");
+  printf("  -n|--clients N        Number of synthetic clients (default 1)\n");
+  printf("  -r|--rate HZ          Client commit rate (default 60)\n");
+  printf("  -d|--duration SEC     Benchmark duration (default 10)\n");
+}
+
+int main(int argc, char **argv) {
+  char const *compositor = NULL;
+  unsigned int outputs = 1;
+  unsigned int clients = 1;
+  unsigned int rate = 60;
+  unsigned int duration = 10;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "c:o:n:r:d:", options, NULL)) != -1) {
+    switch (opt) {
+    case 'c':
+      compositor = optarg;
+      break;
+    case 'o':
+      outputs = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      clients = strtoul(optarg, NULL, 0);
+      break;
+    case 'r':
+      rate = strtoul(optarg, NULL, 0);
+      break;
+    case 'd':
+      duration = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!compositor || !outputs || !rate) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%u", outputs);
+  setenv("WLR_BACKENDS", "headless", 1);
+  setenv("WLR_HEADLESS_OUTPUTS", buf, 1);
+  /* Allow running on machines without a GPU unless told otherwise */
+  setenv("WLR_RENDERER", "pixman", 0);
+
+  printf("%u outputs, %u clients at %u Hz for %u s\n", outputs, clients, rate,
+         duration);
+  fflush(stdout);
+
+  FILE *out = NULL;
+  pid_t compositor_pid = start_compositor(compositor, &out);
+  if (compositor_pid < 0) {
+    return EXIT_FAILURE;
+  }
+
+  char *display_name = read_display_name(out);
+  if (!display_name) {
+    fprintf(stderr, "Compositor did not report a display\n");
+    kill(compositor_pid, SIGTERM);
+    waitpid(compositor_pid, NULL, 0);
+    return EXIT_FAILURE;
+  }
+
+  pid_t *client_pids = calloc(clients, sizeof(*client_pids));
+  for (unsigned int i = 0; i < clients; i++) {
+    client_pids[i] = fork();
+    if (client_pids[i] == 0) {
+      fclose(out);
+      _exit(run_client(display_name, i, rate));
+    }
+  }
+
+  struct timespec remaining = {.tv_sec = duration};
+  while (nanosleep(&remaining, &remaining) && errno == EINTR) {
+  }
+
+  for (unsigned int i = 0; i < clients; i++) {
+    if (client_pids[i] > 0) {
+      kill(client_pids[i], SIGTERM);
+      waitpid(client_pids[i], NULL, 0);
+    }
+  }
+
+  kill(compositor_pid, SIGTERM);
+
+  char line[512];
+  while (fgets(line, sizeof(line), out)) {
+    fputs(line, stdout);
+  }
+  fclose(out);
+
+  int status;
+  waitpid(compositor_pid, &status, 0);
+
+  free(client_pids);
+  free(display_name);
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "Compositor exited abnormally\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "launch.h"
+
+static struct option options[] = {
+    {"rss", required_argument, NULL, 'r'},
+    {"iterations", required_argument, NULL, 'n'},
+    {"program", required_argument, NULL, 'p'},
+    {NULL},
+};
+
+static int64_t now_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_int64(void const *a, void const *b) {
+  int64_t x = *(int64_t const *)a;
+  int64_t y = *(int64_t const *)b;
+  return (x > y) - (x < y);
+}
+
+static void print_samples(char const *name, int64_t *samples, int count) {
+  qsort(samples, count, sizeof(*samples), compare_int64);
+  printf("  %s: p50 %.1f us, p99 %.1f us, max %.1f us\n", name,
+         samples[count / 2] / 1000.0, samples[count * 99 / 100] / 1000.0,
+         samples[count - 1] / 1000.0);
+}
+
+/* The old exec_client() path: fork the whole process, then exec */
+static pid_t fork_exec(char *const argv[]) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    execvp(argv[0], argv);
+    _exit(EXIT_FAILURE);
+  }
+  return pid;
+}
+
+static pid_t launch_exec(char *const argv[]) {
+  return launch_argv(argv, NULL);
+}
+
+static bool run(char const *name, pid_t (*start)(char *const argv[]),
+                char *const argv[], int iterations) {
+  int64_t *blocked = calloc(iterations, sizeof(*blocked));
+  int64_t *total = calloc(iterations, sizeof(*total));
+
+  for (int i = 0; i < iterations; i++) {
+    int64_t start_nsec = now_nsec();
+    pid_t pid = start(argv);
+    int64_t started_nsec = now_nsec();
+    if (pid < 0) {
+      fprintf(stderr, "Unable to start %s: %s\n", argv[0], strerror(errno));
+      free(blocked);
+      free(total);
+      return false;
+    }
+    waitpid(pid, NULL, 0);
+
+    blocked[i] = started_nsec - start_nsec;
+    total[i] = now_nsec() - start_nsec;
+  }
+
+  printf("%s:\n", name);
+  print_samples("caller blocked", blocked, iterations);
+  print_samples("until exit", total, iterations);
+
+  free(blocked);
+  free(total);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  size_t rss_mb = 256;
+  int iterations = 200;
+  char *program = "true";
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "r:n:p:", options, NULL)) != -1) {
+    switch (opt) {
+    case 'r':
+      rss_mb = strtoul(optarg, NULL, 0);
+      break;
+
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+
+    case 'p':
+      program = optarg;
+      break;
+
+    default:
+      printf("Usage: %s [OPTIONS]\n", argv[0]);
+      printf("\n");
+      printf("  -r|--rss MB         Resident memory of the launching process "
+             "(default 256)\n");
+      printf("  -n|--iterations N   Number of launches per method "
+             "(default 200)\n");
+      printf("  -p|--program PROG   Program to launch (default true)\n");
+      exit(EXIT_FAILURE);
+      break;
+    }
+  }
+
+  if (iterations <= 0) {
+    fprintf(stderr, "Invalid iteration count\n");
+    return 1;
+  }
+
+  /*
+   * Touch every page so the mapping is resident and fork() has to copy the
+   * page tables for it, like a compositor with a large renderer state
+   */
+  size_t rss = rss_mb * 1024 * 1024;
+  if (rss) {
+    void *mem = mmap(NULL, rss, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      fprintf(stderr, "Unable to allocate %zu MB: %s\n", rss_mb,
+              strerror(errno));
+      return 1;
+    }
+    memset(mem, 0xa5, rss);
+  }
+
+  printf("Launching %s %d times with %zu MB resident\n", program, iterations,
+         rss_mb);
+
+  char *const prog_argv[] = {program, NULL};
+  if (!run("fork", fork_exec, prog_argv, iterations) ||
+      !run("launch", launch_exec, prog_argv, iterations)) {
+    return 1;
+  }
+  return 0;
+}
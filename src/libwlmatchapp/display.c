@@ -210,6 +210,11 @@ void wlm_display_destroy(struct wlm_display *display) {
 }
 
 int wlm_display_dispatch(struct wlm_display *display) {
+  wlm_display_flush(display);
+  return wl_display_dispatch(display->display);
+}
+
+void wlm_display_flush(struct wlm_display *display) {
   struct wlm_window *window;
   wl_list_for_each(window, &display->private.window_list, private.link) {
     if (window->private.needs_draw) {
@@ -220,7 +225,7 @@ int wlm_display_dispatch(struct wlm_display *display) {
     }
   }
 
-  return wl_display_dispatch(display->display);
+  wl_display_flush(display->display);
 }
 
 static struct cursor_theme *get_cursor_theme(struct wlm_display *display,
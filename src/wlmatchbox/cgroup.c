@@ -0,0 +1,236 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "cgroup.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+#include "server.h"
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+/* Where systemd mounts the unified hierarchy in its hybrid layout */
+#define CGROUP_HYBRID_MOUNT "/sys/fs/cgroup/unified"
+/* How deep to follow the children of a process being moved */
+#define CGROUP_MAX_DEPTH (4)
+
+bool cgroup_write(char const *cgroup, char const *file, char const *value) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", cgroup, file);
+
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  /* The kernel reports invalid values as a failed write */
+  ssize_t len = strlen(value);
+  bool ok = write(fd, value, len) == len;
+  int err = errno;
+  close(fd);
+  errno = err;
+  return ok;
+}
+
+bool cgroup_remove(char const *cgroup) { return rmdir(cgroup) == 0; }
+
+static bool cgroup_move(char const *cgroup, pid_t pid) {
+  char value[32];
+  snprintf(value, sizeof(value), "%d", (int)pid);
+  return cgroup_write(cgroup, "cgroup.procs", value);
+}
+
+static char *cgroup_make(char const *root, char const *name) {
+  char *path = NULL;
+  if (asprintf(&path, "%s/%s", root, name) < 0) {
+    return NULL;
+  }
+  if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+    wlr_log_errno(WLR_ERROR, "Unable to create cgroup %s", path);
+    free(path);
+    return NULL;
+  }
+  return path;
+}
+
+static char const *cgroup_mount(void) {
+  static char const *mount;
+  if (!mount) {
+    mount = access(CGROUP_MOUNT "/cgroup.controllers", F_OK) == 0
+                ? CGROUP_MOUNT
+                : CGROUP_HYBRID_MOUNT;
+  }
+  return mount;
+}
+
+/* The unified hierarchy entry of /proc/PID/cgroup is "0::/path" */
+static char *cgroup_of(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/cgroup", (int)pid);
+  FILE *f = fopen(path, "re");
+  if (!f) {
+    return NULL;
+  }
+
+  char *line = NULL;
+  size_t size = 0;
+  char *cgroup = NULL;
+  while (getline(&line, &size, f) > 0) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      /* Avoid a trailing slash for the root of the hierarchy */
+      char const *path = strcmp(line + 3, "/") == 0 ? "" : line + 3;
+      if (asprintf(&cgroup, "%s%s", cgroup_mount(), path) < 0) {
+        cgroup = NULL;
+      }
+      break;
+    }
+  }
+  free(line);
+  fclose(f);
+  return cgroup;
+}
+
+bool cgroup_init(struct server *server, char const *controllers) {
+  if (!server->cgroup.root) {
+    char *root = cgroup_of(getpid());
+    if (!root) {
+      wlr_log(WLR_ERROR, "Not running in a cgroup v2 hierarchy");
+      return false;
+    }
+
+    char *leaf = cgroup_make(root, "compositor");
+    if (!leaf) {
+      free(root);
+      return false;
+    }
+
+    /*
+     * A cgroup with controllers enabled for its children can't have
+     * processes of its own, so the compositor moves down into a leaf
+     */
+    if (!cgroup_move(leaf, getpid())) {
+      wlr_log_errno(WLR_ERROR,
+                    "Unable to move into %s, is the cgroup delegated?", leaf);
+      cgroup_remove(leaf);
+      free(leaf);
+      free(root);
+      return false;
+    }
+    server->cgroup.root = root;
+    server->cgroup.compositor = leaf;
+    wlr_log(WLR_INFO, "Managing cgroup %s", root);
+  }
+
+  char const *root = server->cgroup.root;
+  if (controllers &&
+      !cgroup_write(root, "cgroup.subtree_control", controllers)) {
+    wlr_log_errno(WLR_ERROR, "Unable to enable %s in %s", controllers, root);
+    return false;
+  }
+  return true;
+}
+
+char *cgroup_create(struct server *server, char const *name) {
+  return cgroup_make(server->cgroup.root, name);
+}
+
+char *cgroup_create_app(struct server *server) {
+  if (!server->cgroup.root) {
+    return NULL;
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "app-%" PRIu32, ++server->cgroup.last_id);
+  return cgroup_create(server, name);
+}
+
+/*
+ * Move the processes started by pid (e.g. the content processes of a
+ * browser) that are still in the cgroup it came from
+ */
+static void cgroup_move_children(char const *leaf, char const *from, pid_t pid,
+                                 int depth) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    char children_path[128];
+    snprintf(children_path, sizeof(children_path), "%s/%s/children", path,
+             ent->d_name);
+    FILE *f = fopen(children_path, "re");
+    if (!f) {
+      continue;
+    }
+    int child;
+    while (fscanf(f, "%d", &child) == 1) {
+      char *cgroup = cgroup_of(child);
+      if (cgroup && strcmp(cgroup, from) == 0 && cgroup_move(leaf, child) &&
+          depth < CGROUP_MAX_DEPTH) {
+        cgroup_move_children(leaf, from, child, depth + 1);
+      }
+      free(cgroup);
+    }
+    fclose(f);
+  }
+  closedir(dir);
+}
+
+char *cgroup_create_leaf(struct server *server, char const *name, pid_t pid) {
+  char *from = cgroup_of(pid);
+  if (!from) {
+    return NULL;
+  }
+  char *leaf = cgroup_create(server, name);
+  if (!leaf) {
+    free(from);
+    return NULL;
+  }
+  if (!cgroup_move(leaf, pid)) {
+    /* Processes outside the delegated directory can't be moved into it */
+    wlr_log_errno(WLR_DEBUG, "Unable to move %d into %s", (int)pid, leaf);
+    cgroup_remove(leaf);
+    free(leaf);
+    free(from);
+    return NULL;
+  }
+  cgroup_move_children(leaf, from, pid, 1);
+  free(from);
+  return leaf;
+}
+
+char *cgroup_find(struct server *server, pid_t pid) {
+  char const *root = server->cgroup.root;
+  if (!root) {
+    return NULL;
+  }
+
+  char *cgroup = cgroup_of(pid);
+  size_t len = strlen(root);
+  if (cgroup && strncmp(cgroup, root, len) == 0 && cgroup[len] == '/' &&
+      !strchr(cgroup + len + 1, '/') &&
+      strcmp(cgroup, server->cgroup.compositor) != 0) {
+    return cgroup;
+  }
+  free(cgroup);
+  return NULL;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CGROUP_H
+#define _CGROUP_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+struct server;
+
+/*
+ * Take over the cgroup v2 directory the compositor was started in, which must
+ * have been delegated to it (e.g. a systemd unit with Delegate=yes). The
+ * compositor moves itself into a "compositor" leaf so that clients can be
+ * given leaves of their own next to it, and enables the controllers in
+ * controllers (e.g. "+cpu"). Returns false if the directory can't be managed.
+ * Calling it again only enables any further controllers.
+ */
+bool cgroup_init(struct server *server, char const *controllers);
+
+/*
+ * Create the leaf name under the delegated directory, if it doesn't exist.
+ * Returns its path, or NULL on error.
+ */
+char *cgroup_create(struct server *server, char const *name);
+
+/*
+ * The same, and move the process pid into it, along with the processes it
+ * started that are still in the same cgroup as it
+ */
+char *cgroup_create_leaf(struct server *server, char const *name, pid_t pid);
+
+/*
+ * Create a new, empty leaf to start an application in, so that everything it
+ * starts is in the leaf from the beginning. Returns NULL if the compositor
+ * doesn't manage a cgroup directory.
+ */
+char *cgroup_create_app(struct server *server);
+
+/*
+ * Find the leaf under the delegated directory that the process pid is in,
+ * other than the compositor's. Returns NULL if there isn't one.
+ */
+char *cgroup_find(struct server *server, pid_t pid);
+
+/* Write value to the interface file in a cgroup directory */
+bool cgroup_write(char const *cgroup, char const *file, char const *value);
+
+/* Remove a leaf. This fails while there are still processes in it */
+bool cgroup_remove(char const *cgroup);
+
+#endif
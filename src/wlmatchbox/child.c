@@ -0,0 +1,153 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "child.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+#include "cgroup.h"
+#include "launch.h"
+#include "probes.h"
+#include "server.h"
+
+DEFINE_TYPE(child)
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open (434)
+#endif
+
+#ifndef P_PIDFD
+#define P_PIDFD (3)
+#endif
+
+static int pidfd_open_pid(pid_t pid) {
+  return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static void child_destroy(struct child *child) {
+  wl_event_source_remove(child->source);
+  close(child->pidfd);
+  wl_list_remove(&child->link);
+  /* Anything it started that is still running keeps the cgroup alive */
+  if (child->cgroup && !cgroup_remove(child->cgroup)) {
+    wlr_log_errno(WLR_DEBUG, "Unable to remove %s", child->cgroup);
+  }
+  free(child->cgroup);
+  free(child->name);
+  free(child);
+}
+
+static int child_pidfd_readable(int fd, uint32_t mask, void *data) {
+  struct child *child = check_sig_child(data);
+  watchdog_mark("child.exit");
+
+  /*
+   * The pidfd only becomes readable once the process has exited, and it
+   * refers to this process only, so there is no race with pid reuse or with
+   * anything else reaping children
+   */
+  siginfo_t info = {0};
+  if (waitid(P_PIDFD, child->pidfd, &info, WEXITED | WNOHANG) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to reap %s (%d)", child->name,
+                  child->pid);
+    child_destroy(child);
+    return 0;
+  }
+  if (info.si_pid == 0) {
+    /* Spurious wakeup, the process is still running */
+    return 0;
+  }
+
+  child->killed = info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED;
+  child->status = info.si_status;
+  child->runtime_nsec = get_time_nsec() - child->start_nsec;
+
+  double runtime = (double)child->runtime_nsec / NSEC_PER_SEC;
+  if (child->killed) {
+    wlr_log(WLR_INFO, "%s (%d) killed by signal %d (%s) after %.3f s",
+            child->name, child->pid, child->status, strsignal(child->status),
+            runtime);
+  } else {
+    wlr_log(child->status ? WLR_INFO : WLR_DEBUG,
+            "%s (%d) exited with status %d after %.3f s", child->name,
+            child->pid, child->status, runtime);
+  }
+
+  wl_signal_emit_mutable(&child->events.exit, child);
+  child_destroy(child);
+  return 0;
+}
+
+struct child *child_create(struct server *server, pid_t pid, char const *name) {
+  int pidfd = pidfd_open_pid(pid);
+  if (pidfd < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to open pidfd for %s (%d)", name, pid);
+    return NULL;
+  }
+
+  struct child *child = alloc_child();
+  child->server = server;
+  child->pid = pid;
+  child->pidfd = pidfd;
+  child->name = strdup(name);
+  child->start_nsec = get_time_nsec();
+  wl_signal_init(&child->events.exit);
+
+  child->source = wl_event_loop_add_fd(
+      wl_display_get_event_loop(server->wl_display), pidfd, WL_EVENT_READABLE,
+      child_pidfd_readable, child);
+  if (!child->source) {
+    wlr_log(WLR_ERROR, "Unable to watch %s (%d)", name, pid);
+    close(pidfd);
+    free(child->name);
+    free(child);
+    return NULL;
+  }
+  wl_list_insert(&server->children, &child->link);
+
+  wlr_log(WLR_DEBUG, "Started %s (%d)", child->name, child->pid);
+  PROBE2(spawn, child->name, child->pid);
+  return child;
+}
+
+struct child *child_launch(struct server *server, char const *command,
+                           struct launch_options const *options) {
+  struct launch_options launch_options = {
+      .wayland_socket = -1,
+  };
+  if (options) {
+    launch_options = *options;
+  }
+  char *cgroup = cgroup_create_app(server);
+  if (cgroup) {
+    launch_options.cgroup = cgroup;
+  }
+
+  int64_t start_nsec = get_time_nsec();
+  pid_t pid = launch_command(command, &launch_options);
+  if (pid < 0) {
+    if (cgroup) {
+      cgroup_remove(cgroup);
+    }
+    free(cgroup);
+    return NULL;
+  }
+
+  struct child *child = child_create(server, pid, command);
+  if (child) {
+    child->start_nsec = start_nsec;
+    child->cgroup = cgroup;
+  } else {
+    free(cgroup);
+  }
+  return child;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CHILD_H
+#define _CHILD_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <wayland-server.h>
+
+#include "util.h"
+
+struct server;
+struct launch_options;
+
+/*
+ * A process started by the compositor. Its pidfd is watched by the event loop
+ * and the process is reaped as soon as it exits, at which point the exit
+ * signal is emitted and the child is freed.
+ */
+struct child {
+  struct wl_list link;
+  struct server *server;
+  pid_t pid;
+  int pidfd;
+  char *name;
+  int64_t start_nsec;
+  struct wl_event_source *source;
+  /* The cgroup the process was started in, if it has one of its own */
+  char *cgroup;
+
+  /* Valid in the exit signal */
+  bool killed;
+  int status;
+  int64_t runtime_nsec;
+
+  struct {
+    struct wl_signal exit;
+  } events;
+
+  struct child_sig const *sig;
+};
+DECLARE_TYPE(child)
+
+struct child *child_create(struct server *server, pid_t pid, char const *name);
+struct child *child_launch(struct server *server, char const *command,
+                           struct launch_options const *options);
+
+#endif
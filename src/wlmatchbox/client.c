@@ -0,0 +1,272 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "client.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+
+#include "cgroup.h"
+#include "child.h"
+#include "freezer.h"
+#include "hud.h"
+#include "output.h"
+#include "priority.h"
+#include "server.h"
+#include "shm.h"
+#include "toplevel.h"
+
+DEFINE_TYPE(client)
+
+static struct app_stats *app_stats_get(struct server *server,
+                                       char const *app_id) {
+  struct app_stats *app;
+  wl_list_for_each(app, &server->app_stats, link) {
+    if (strcmp(app->app_id, app_id) == 0) {
+      return app;
+    }
+  }
+
+  app = calloc(1, sizeof(*app));
+  app->app_id = strdup(app_id);
+  histogram_reset(&app->map_latency);
+  histogram_reset(&app->present_latency);
+  wl_list_insert(server->app_stats.prev, &app->link);
+  return app;
+}
+
+static void client_destroy_notify(struct wl_listener *listener, void *data) {
+  struct client *client = get_type_ptr(client, listener, client, destroy);
+
+  if (client->map_nsec && !client->present_nsec) {
+    client->server->clients_pending_present--;
+  }
+  shm_client_destroy(client);
+  freezer_client_destroy(client);
+  priority_client_destroy(client);
+  hud_client_destroy(client);
+  wl_list_remove(&client->destroy.link);
+  wl_list_remove(&client->link);
+  free(client->app_id);
+  free(client);
+}
+
+/*
+ * A program's leaf is inherited by everything it starts, e.g. the
+ * applications started by a launcher or a wrapper script. Only the program it
+ * was created for keeps it, and any other process is moved into a leaf of its
+ * own when it connects, so that freezing or killing the client doesn't take
+ * the process that started it along. If it can't be moved it gets no cgroup.
+ */
+static void client_find_cgroup(struct client *client, struct child *spawned) {
+  struct server *server = client->server;
+  client->cgroup = cgroup_find(server, client->pid);
+  if (!client->cgroup ||
+      (spawned && spawned->cgroup &&
+       strcmp(spawned->cgroup, client->cgroup) == 0)) {
+    return;
+  }
+
+  /* Another connection of a process that was already moved */
+  char name[32];
+  snprintf(name, sizeof(name), "client-%d", (int)client->pid);
+  if (strcmp(strrchr(client->cgroup, '/') + 1, name) == 0) {
+    return;
+  }
+
+  free(client->cgroup);
+  client->cgroup = cgroup_create_leaf(server, name, client->pid);
+}
+
+bool client_cgroup_shared(struct client *client) {
+  if (!client->cgroup) {
+    return false;
+  }
+  struct client *other;
+  wl_list_for_each(other, &client->server->clients, link) {
+    if (other != client && other->cgroup &&
+        strcmp(other->cgroup, client->cgroup) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void client_created_notify(struct wl_listener *listener, void *data) {
+  struct server *server =
+      get_type_ptr(server, listener, server, client_created);
+  struct wl_client *wl_client = data;
+
+  struct client *client = alloc_client();
+  client->server = server;
+  client->wl_client = wl_client;
+  client->start_nsec = get_time_nsec();
+  wl_client_get_credentials(wl_client, &client->pid, NULL, NULL);
+
+  /*
+   * Programs started by the compositor that connect through the display
+   * socket are found by their pid. Clients with a preconnected socket report
+   * the compositor's own pid and are marked by exec_client() instead.
+   */
+  struct child *spawned = NULL;
+  struct child *child;
+  wl_list_for_each(child, &server->children, link) {
+    if (child->pid == client->pid) {
+      client->spawned = true;
+      client->start_nsec = child->start_nsec;
+      spawned = child;
+      break;
+    }
+  }
+
+  /* Clients the compositor started, or that they started, have a cgroup */
+  client_find_cgroup(client, spawned);
+
+  shm_client_init(client);
+  client->destroy.notify = client_destroy_notify;
+  wl_client_add_destroy_listener(wl_client, &client->destroy);
+  wl_list_insert(&server->clients, &client->link);
+}
+
+struct client *client_from_wl_client(struct server *server,
+                                     struct wl_client *wl_client) {
+  struct wl_listener *listener =
+      wl_client_get_destroy_listener(wl_client, client_destroy_notify);
+  if (!listener) {
+    return NULL;
+  }
+  struct client *client;
+  return check_sig_client(wl_container_of(listener, client, destroy));
+}
+
+void client_set_spawned(struct client *client, pid_t pid, int64_t start_nsec) {
+  client->spawned = true;
+  client->pid = pid;
+  client->start_nsec = start_nsec;
+}
+
+void client_surface_commit(struct server *server, struct wlr_surface *surface) {
+  struct client *client =
+      client_from_wl_client(server, wl_resource_get_client(surface->resource));
+  if (!client) {
+    return;
+  }
+  client->commits++;
+
+  if (!pixman_region32_not_empty(&surface->buffer_damage)) {
+    return;
+  }
+  client->damage_commits++;
+
+  /* Catches clients that redraw everything for small changes */
+  pixman_box32_t full = {
+      .x2 = surface->current.buffer_width,
+      .y2 = surface->current.buffer_height,
+  };
+  if (pixman_region32_contains_rectangle(&surface->buffer_damage, &full) ==
+      PIXMAN_REGION_IN) {
+    client->full_damage_commits++;
+  }
+}
+
+void client_toplevel_map(struct toplevel *toplevel) {
+  struct wl_client *wl_client =
+      wl_resource_get_client(toplevel->xdg_toplevel->resource);
+  struct client *client = client_from_wl_client(toplevel->server, wl_client);
+  if (!client || client->map_nsec) {
+    return;
+  }
+
+  char const *app_id = toplevel->xdg_toplevel->app_id;
+  client->app_id = strdup(app_id && *app_id ? app_id : "(none)");
+  client->map_nsec = get_time_nsec();
+  client->map_output = toplevel->output;
+  toplevel->server->clients_pending_present++;
+}
+
+void client_output_present(struct output *output, int64_t commit_nsec,
+                           int64_t present_nsec) {
+  struct server *server = output->server;
+  struct client *client;
+  wl_list_for_each(client, &server->clients, link) {
+    /*
+     * The first frame is the first one presented on the output the toplevel
+     * mapped on that was committed after the map
+     */
+    if (!client->map_nsec || client->present_nsec ||
+        commit_nsec < client->map_nsec ||
+        (client->map_output && client->map_output != output)) {
+      continue;
+    }
+    client->present_nsec = present_nsec;
+    server->clients_pending_present--;
+
+    struct app_stats *app = app_stats_get(server, client->app_id);
+    int64_t map_latency = client->map_nsec - client->start_nsec;
+    int64_t present_latency = present_nsec - client->start_nsec;
+    app->launches++;
+    histogram_add(&app->map_latency, map_latency);
+    histogram_add(&app->present_latency, present_latency);
+
+    wlr_log(WLR_INFO,
+            "%s (%d) first frame %.1f ms after %s, mapped after %.1f ms",
+            client->app_id, client->pid,
+            (double)present_latency / NSEC_PER_MSEC,
+            client->spawned ? "launch" : "connecting",
+            (double)map_latency / NSEC_PER_MSEC);
+  }
+}
+
+void client_output_destroy(struct output *output) {
+  struct client *client;
+  wl_list_for_each(client, &output->server->clients, link) {
+    if (client->map_output == output) {
+      client->map_output = NULL;
+    }
+  }
+}
+
+void client_print_stats(struct server *server, FILE *f) {
+  struct app_stats *app;
+  wl_list_for_each(app, &server->app_stats, link) {
+    fprintf(f, "app %s: %" PRIu64 " launches\n", app->app_id, app->launches);
+    histogram_print_msec(&app->map_latency, f, "launch to map");
+    histogram_print_msec(&app->present_latency, f, "launch to first frame");
+  }
+
+  struct client *client;
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f,
+            "client %d (%s): %d surfaces, %d shm pools of %" PRIu64
+            " KiB, %d shm buffers of %" PRIu64 " KiB\n",
+            client->pid, client->app_id ? client->app_id : "no toplevel",
+            client->shm.surfaces, client->shm.pools,
+            client->shm.pool_bytes >> 10, client->shm.buffers,
+            client->shm.buffer_bytes >> 10);
+  }
+
+  wl_list_for_each(client, &server->clients, link) {
+    if (!client->damage_commits) {
+      continue;
+    }
+    fprintf(f,
+            "client %d (%s): %" PRIu64 " commits, %" PRIu64
+            " damaging, %" PRIu64 " damaging the whole surface\n",
+            client->pid, client->app_id ? client->app_id : "no toplevel",
+            client->commits, client->damage_commits,
+            client->full_damage_commits);
+  }
+}
+
+void client_init(struct server *server) {
+  wl_list_init(&server->clients);
+  wl_list_init(&server->app_stats);
+  server->client_created.notify = client_created_notify;
+  wl_display_add_client_created_listener(server->wl_display,
+                                         &server->client_created);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _CLIENT_H
+#define _CLIENT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <wayland-server.h>
+
+#include "shm.h"
+#include "stats.h"
+#include "util.h"
+
+struct output;
+struct shm_resource;
+struct toplevel;
+struct wlr_surface;
+
+enum cpu_class {
+  CPU_CLASS_DEFAULT,
+  CPU_CLASS_FOREGROUND,
+  CPU_CLASS_BACKGROUND,
+};
+
+/*
+ * A connected Wayland client. The launch time is when the compositor spawned
+ * the process if it did, otherwise when the client connected.
+ */
+struct client {
+  struct wl_list link;
+  struct server *server;
+  struct wl_client *wl_client;
+  pid_t pid;
+  bool spawned;
+  int64_t start_nsec;
+  uint64_t commits;
+  /* Commits that damaged the surface, and those that damaged all of it */
+  uint64_t damage_commits;
+  uint64_t full_damage_commits;
+
+  /* Set when the first toplevel maps */
+  char *app_id;
+  int64_t map_nsec;
+  struct output *map_output;
+  /* Set when the first frame after the map is presented */
+  int64_t present_nsec;
+
+  /* The CPU priority the client was last given, and its cgroup if any */
+  enum cpu_class cpu_class;
+  char *cgroup;
+  /* All of its toplevels are hidden, and it has been frozen because of it */
+  bool hidden;
+  bool frozen;
+  struct wl_event_source *freeze_timer;
+  /* When the low memory manager asked it to close */
+  int64_t lowmem_close_nsec;
+  /* Killing it failed, so the low memory manager leaves it alone */
+  bool lowmem_unkillable;
+
+  /*
+   * Live wl_shm pools and buffers, and surfaces. A destroyed pool is counted
+   * until its last buffer is gone, as it stays mapped until then
+   */
+  struct {
+    struct wl_list resources;
+    struct wl_listener resource_created;
+    int pools;
+    uint64_t pool_bytes;
+    int buffers;
+    uint64_t buffer_bytes;
+    int surfaces;
+    bool over_soft_limit;
+
+    /* Pool or buffer being created by the request being dispatched */
+    uint32_t pending_id;
+    enum shm_resource_type pending_type;
+    uint64_t pending_bytes;
+    struct shm_resource *pending_pool;
+  } shm;
+
+  struct wl_listener destroy;
+
+  struct client_sig const *sig;
+};
+DECLARE_TYPE(client)
+
+/* Launch latencies of all the clients with the same app_id */
+struct app_stats {
+  struct wl_list link;
+  char *app_id;
+  uint64_t launches;
+  struct histogram map_latency;
+  struct histogram present_latency;
+};
+
+void client_init(struct server *server);
+struct client *client_from_wl_client(struct server *server,
+                                     struct wl_client *wl_client);
+void client_set_spawned(struct client *client, pid_t pid, int64_t start_nsec);
+/* Whether another live client is in the same cgroup as the client */
+bool client_cgroup_shared(struct client *client);
+void client_surface_commit(struct server *server, struct wlr_surface *surface);
+void client_toplevel_map(struct toplevel *toplevel);
+void client_output_present(struct output *output, int64_t commit_nsec,
+                           int64_t present_nsec);
+void client_output_destroy(struct output *output);
+void client_print_stats(struct server *server, FILE *f);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "freezer.h"
+
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+
+#include "cgroup.h"
+#include "client.h"
+#include "server.h"
+#include "toplevel.h"
+#include "trace.h"
+
+void freezer_init(struct server *server) {
+  if (server->options.freeze_msec <= 0) {
+    return;
+  }
+
+  /* The freezer is part of every cgroup, no controller has to be enabled */
+  if (!cgroup_init(server, NULL)) {
+    wlr_log(WLR_ERROR, "Unable to freeze hidden clients");
+    server->options.freeze_msec = 0;
+  }
+}
+
+/* Whether the client has toplevels, and none of them can be seen */
+static bool freezer_client_hidden(struct client *client) {
+  struct server *server = client->server;
+  if (client->wl_client == server->panel_client) {
+    return false;
+  }
+
+  bool hidden = false;
+  struct toplevel *toplevel;
+  wl_list_for_each(toplevel, &server->toplevels, link) {
+    if (wl_resource_get_client(toplevel->xdg_toplevel->resource) !=
+        client->wl_client) {
+      continue;
+    }
+    if (!toplevel->suspended) {
+      return false;
+    }
+    hidden = true;
+  }
+  return hidden;
+}
+
+static void freezer_set_frozen(struct client *client, bool frozen) {
+  if (!cgroup_write(client->cgroup, "cgroup.freeze", frozen ? "1" : "0")) {
+    wlr_log_errno(WLR_ERROR, "Unable to %s %s", frozen ? "freeze" : "thaw",
+                  client->cgroup);
+    return;
+  }
+  client->frozen = frozen;
+  trace_instant("client", frozen ? "freeze" : "thaw", "pid", client->pid);
+  wlr_log(WLR_DEBUG, "%s %s (%d)", frozen ? "Froze" : "Thawed",
+          client->app_id ? client->app_id : "client", (int)client->pid);
+}
+
+static int freezer_timer(void *data) {
+  struct client *client = check_sig_client(data);
+  watchdog_mark("freezer.timer");
+
+  /*
+   * Another connection of the same process is in the cgroup too, and may
+   * still be visible
+   */
+  if (client->hidden && !client->frozen && !client_cgroup_shared(client)) {
+    freezer_set_frozen(client, true);
+  }
+  return 0;
+}
+
+void freezer_update(struct client *client) {
+  if (!client || !client->cgroup ||
+      client->server->options.freeze_msec <= 0) {
+    return;
+  }
+
+  bool hidden = freezer_client_hidden(client);
+  if (hidden == client->hidden) {
+    return;
+  }
+  client->hidden = hidden;
+
+  struct server *server = client->server;
+  if (!client->freeze_timer) {
+    client->freeze_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->wl_display), freezer_timer, client);
+  }
+  if (hidden) {
+    wl_event_source_timer_update(client->freeze_timer,
+                                 server->options.freeze_msec);
+  } else {
+    wl_event_source_timer_update(client->freeze_timer, 0);
+    freezer_thaw(client);
+  }
+}
+
+void freezer_thaw(struct client *client) {
+  if (!client) {
+    return;
+  }
+  if (client->frozen) {
+    freezer_set_frozen(client, false);
+  }
+  /* Start the grace period again if it is still hidden afterwards */
+  client->hidden = false;
+}
+
+void freezer_client_destroy(struct client *client) {
+  if (client->freeze_timer) {
+    wl_event_source_remove(client->freeze_timer);
+  }
+  /* The process may still be running without its connection */
+  freezer_thaw(client);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _FREEZER_H
+#define _FREEZER_H
+
+struct client;
+struct server;
+
+/*
+ * Clients started by the compositor run in cgroups of their own. Once every
+ * toplevel of a client has been hidden (covered, minimized or without an
+ * enabled output) for server->options.freeze_msec its cgroup is frozen, so it
+ * uses no CPU at all, and it is thawed as soon as one of them is shown again.
+ *
+ * If the cgroup can't be set up freezing is turned off.
+ */
+void freezer_init(struct server *server);
+
+/* Called when the toplevels of the client are shown, hidden or unmapped */
+void freezer_update(struct client *client);
+
+/* Thaw the client now, e.g. because it is about to be focused */
+void freezer_thaw(struct client *client);
+
+void freezer_client_destroy(struct client *client);
+
+#endif
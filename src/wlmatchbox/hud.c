@@ -0,0 +1,322 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "hud.h"
+
+#include <ctype.h>
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/util/log.h>
+
+#include "client.h"
+#include "output.h"
+#include "server.h"
+
+DEFINE_TYPE(hud)
+
+#define HUD_LINES (6)
+#define HUD_LINE_CHARS (24)
+/* Size of a glyph, and of a character cell including its spacing */
+#define GLYPH_WIDTH (5)
+#define GLYPH_HEIGHT (7)
+#define CELL_WIDTH (GLYPH_WIDTH + 1)
+#define CELL_HEIGHT (GLYPH_HEIGHT + 2)
+#define HUD_SCALE (2)
+#define HUD_PADDING (6)
+#define HUD_MARGIN (8)
+
+/*
+ * 5x7 bitmap font covering what the HUD draws. Each row is 5 bits with the
+ * leftmost pixel in bit 4. Lower case letters are drawn as upper case
+ */
+static char const font_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.%:/-_ ";
+static uint8_t const font[][GLYPH_HEIGHT] = {
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, /* 0 */
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, /* 1 */
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, /* 2 */
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, /* 3 */
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, /* 4 */
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, /* 5 */
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, /* 6 */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, /* 7 */
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, /* 8 */
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, /* 9 */
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, /* A */
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, /* B */
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, /* C */
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, /* D */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, /* E */
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, /* F */
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, /* G */
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, /* H */
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, /* I */
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, /* J */
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, /* K */
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, /* L */
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, /* M */
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, /* N */
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, /* O */
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, /* P */
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, /* Q */
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, /* R */
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, /* S */
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, /* T */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, /* U */
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, /* V */
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, /* W */
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, /* X */
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, /* Y */
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, /* Z */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, /* . */
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, /* % */
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, /* : */
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, /* / */
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, /* - */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, /* _ */
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, /* space */
+};
+static uint8_t const unknown_glyph[GLYPH_HEIGHT] = {0x0E, 0x11, 0x01, 0x02,
+                                                    0x04, 0x00, 0x04};
+
+/* A CPU memory buffer the scene can render from */
+struct hud_buffer {
+  struct wlr_buffer base;
+  uint32_t *data;
+  size_t stride;
+};
+
+static void hud_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+  struct hud_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+  wlr_buffer_finish(wlr_buffer);
+  free(buffer->data);
+  free(buffer);
+}
+
+static bool hud_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+                                             uint32_t flags, void **data,
+                                             uint32_t *format, size_t *stride) {
+  struct hud_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+  if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE) {
+    return false;
+  }
+  *data = buffer->data;
+  *format = DRM_FORMAT_ARGB8888;
+  *stride = buffer->stride;
+  return true;
+}
+
+static void hud_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {}
+
+static struct wlr_buffer_impl const hud_buffer_impl = {
+    .destroy = hud_buffer_destroy,
+    .begin_data_ptr_access = hud_buffer_begin_data_ptr_access,
+    .end_data_ptr_access = hud_buffer_end_data_ptr_access,
+};
+
+static uint8_t const *find_glyph(char c) {
+  char const *p = strchr(font_chars, toupper((unsigned char)c));
+  return p && c ? font[p - font_chars] : unknown_glyph;
+}
+
+static struct hud_buffer *hud_render_text(char lines[][HUD_LINE_CHARS],
+                                          int num_lines) {
+  size_t max_len = 1;
+  for (int i = 0; i < num_lines; i++) {
+    size_t len = strlen(lines[i]);
+    if (len > max_len) {
+      max_len = len;
+    }
+  }
+
+  int width = max_len * CELL_WIDTH * HUD_SCALE;
+  int height = num_lines * CELL_HEIGHT * HUD_SCALE;
+
+  struct hud_buffer *buffer = calloc(1, sizeof(*buffer));
+  buffer->stride = width * sizeof(uint32_t);
+  buffer->data = calloc(height, buffer->stride);
+  if (!buffer->data) {
+    free(buffer);
+    return NULL;
+  }
+  wlr_buffer_init(&buffer->base, &hud_buffer_impl, width, height);
+
+  for (int line = 0; line < num_lines; line++) {
+    for (int col = 0; lines[line][col]; col++) {
+      uint8_t const *glyph = find_glyph(lines[line][col]);
+      for (int gy = 0; gy < GLYPH_HEIGHT; gy++) {
+        for (int gx = 0; gx < GLYPH_WIDTH; gx++) {
+          if (!(glyph[gy] & (0x10 >> gx))) {
+            continue;
+          }
+          int x0 = (col * CELL_WIDTH + gx) * HUD_SCALE;
+          int y0 = (line * CELL_HEIGHT + gy) * HUD_SCALE;
+          for (int y = y0; y < y0 + HUD_SCALE; y++) {
+            for (int x = x0; x < x0 + HUD_SCALE; x++) {
+              buffer->data[y * width + x] = 0xFFFFFFFF;
+            }
+          }
+        }
+      }
+    }
+  }
+  return buffer;
+}
+
+static void hud_update(struct hud *hud, int64_t now, double focused_commits) {
+  struct output *output = hud->output;
+  struct server *server = output->server;
+  double elapsed = (now - hud->update_nsec) / (double)NSEC_PER_SEC;
+
+  uint64_t frames = output->stats.frames - hud->frames;
+  uint64_t render_count = output->stats.render_time.count - hud->render_count;
+  int64_t render_sum = output->stats.render_time.sum - hud->render_sum;
+  uint64_t damage_pixels = output->stats.damage_pixels - hud->damage_pixels;
+  uint64_t output_pixels = (uint64_t)output->wlr_output->width *
+                           output->wlr_output->height * frames;
+
+  char lines[HUD_LINES][HUD_LINE_CHARS];
+  snprintf(lines[0], sizeof(lines[0]), "%s", output->wlr_output->name);
+  snprintf(lines[1], sizeof(lines[1]), "FPS %.1f",
+           elapsed > 0 ? frames / elapsed : 0);
+  snprintf(lines[2], sizeof(lines[2]), "FRAME %.1fMS",
+           frames ? elapsed * 1000 / frames : 0);
+  snprintf(lines[3], sizeof(lines[3]), "RENDER %.2fMS",
+           render_count ? render_sum / (double)render_count / NSEC_PER_MSEC
+                        : 0);
+  snprintf(lines[4], sizeof(lines[4]), "DAMAGE %.1f%%",
+           output_pixels ? damage_pixels * 100.0 / output_pixels : 0);
+  snprintf(lines[5], sizeof(lines[5]), "COMMITS %.0f/S", focused_commits);
+
+  hud->update_nsec = now;
+  hud->frames = output->stats.frames;
+  hud->render_count = output->stats.render_time.count;
+  hud->render_sum = output->stats.render_time.sum;
+  hud->damage_pixels = output->stats.damage_pixels;
+
+  struct hud_buffer *buffer = hud_render_text(lines, HUD_LINES);
+  if (!buffer) {
+    return;
+  }
+  wlr_scene_buffer_set_buffer(hud->text, &buffer->base);
+  wlr_scene_rect_set_size(hud->background,
+                          buffer->base.width + 2 * HUD_PADDING,
+                          buffer->base.height + 2 * HUD_PADDING);
+  wlr_buffer_drop(&buffer->base);
+
+  /* Follow the output if the layout changed */
+  struct wlr_output_layout_output *l_output =
+      wlr_output_layout_get(server->output_layout, output->wlr_output);
+  if (l_output) {
+    wlr_scene_node_set_position(&hud->tree->node, l_output->x + HUD_MARGIN,
+                                l_output->y + HUD_MARGIN);
+  }
+}
+
+static int hud_timer(void *data) {
+  struct server *server = check_sig_server(data);
+  int64_t now = get_time_nsec();
+  watchdog_mark("hud.timer");
+
+  /* Commit rate of the client with the keyboard focus */
+  double focused_commits = 0;
+  struct wlr_surface *surface = server->seat->keyboard_state.focused_surface;
+  struct client *client =
+      surface ? client_from_wl_client(server,
+                                      wl_resource_get_client(surface->resource))
+              : NULL;
+  if (client && client == server->hud.focused_client) {
+    double elapsed = (now - server->hud.update_nsec) / (double)NSEC_PER_SEC;
+    if (elapsed > 0) {
+      focused_commits =
+          (client->commits - server->hud.focused_commits) / elapsed;
+    }
+  }
+  server->hud.focused_client = client;
+  server->hud.focused_commits = client ? client->commits : 0;
+  server->hud.update_nsec = now;
+
+  struct output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (output->hud) {
+      hud_update(output->hud, now, focused_commits);
+    }
+  }
+
+  wl_event_source_timer_update(server->hud.timer, HUD_UPDATE_MSEC);
+  return 0;
+}
+
+void hud_add_output(struct output *output) {
+  struct server *server = output->server;
+  if (!server->hud.enabled || output->hud) {
+    return;
+  }
+
+  struct hud *hud = alloc_hud();
+  hud->output = output;
+  hud->tree = wlr_scene_tree_create(server->layers.overlay);
+  hud->background = wlr_scene_rect_create(hud->tree, 0, 0,
+                                          (float[4]){0.0, 0.0, 0.0, 0.6});
+  hud->text = wlr_scene_buffer_create(hud->tree, NULL);
+  wlr_scene_node_set_position(&hud->text->node, HUD_PADDING, HUD_PADDING);
+
+  hud->update_nsec = get_time_nsec();
+  hud->frames = output->stats.frames;
+  hud->render_count = output->stats.render_time.count;
+  hud->render_sum = output->stats.render_time.sum;
+  hud->damage_pixels = output->stats.damage_pixels;
+  output->hud = hud;
+
+  hud_update(hud, hud->update_nsec, 0);
+}
+
+void hud_remove_output(struct output *output) {
+  struct hud *hud = output->hud;
+  if (!hud) {
+    return;
+  }
+  wlr_scene_node_destroy(&hud->tree->node);
+  free(hud);
+  output->hud = NULL;
+}
+
+void hud_client_destroy(struct client *client) {
+  /* Another client allocated at the same address mustn't look the same */
+  struct server *server = client->server;
+  if (server->hud.focused_client == client) {
+    server->hud.focused_client = NULL;
+  }
+}
+
+void hud_toggle(struct server *server) {
+  struct output *output;
+
+  if (server->hud.enabled) {
+    server->hud.enabled = false;
+    wl_list_for_each(output, &server->outputs, link) {
+      hud_remove_output(output);
+    }
+    wl_event_source_remove(server->hud.timer);
+    server->hud.timer = NULL;
+    server->hud.focused_client = NULL;
+    return;
+  }
+
+  server->hud.enabled = true;
+  server->hud.update_nsec = get_time_nsec();
+  server->hud.timer = wl_event_loop_add_timer(
+      wl_display_get_event_loop(server->wl_display), hud_timer, server);
+  wl_event_source_timer_update(server->hud.timer, HUD_UPDATE_MSEC);
+  wl_list_for_each(output, &server->outputs, link) {
+    hud_add_output(output);
+  }
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _HUD_H
+#define _HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+#include "util.h"
+
+struct server;
+struct output;
+struct client;
+
+/* How often the HUD text is redrawn */
+#define HUD_UPDATE_MSEC (250)
+
+/*
+ * Per-output performance overlay, drawn in the overlay layer of the scene. It
+ * only exists while the HUD is shown, so when it is hidden nothing is tracked
+ * and no timer runs.
+ */
+struct hud {
+  struct output *output;
+  struct wlr_scene_tree *tree;
+  struct wlr_scene_rect *background;
+  struct wlr_scene_buffer *text;
+
+  /* Output counters at the last update */
+  int64_t update_nsec;
+  uint64_t frames;
+  uint64_t render_count;
+  int64_t render_sum;
+  uint64_t damage_pixels;
+
+  struct hud_sig const *sig;
+};
+DECLARE_TYPE(hud)
+
+void hud_toggle(struct server *server);
+void hud_add_output(struct output *output);
+void hud_remove_output(struct output *output);
+void hud_client_destroy(struct client *client);
+
+#endif
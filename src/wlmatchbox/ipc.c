@@ -0,0 +1,616 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "ipc.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+
+#include "child.h"
+#include "client.h"
+#include "json.h"
+#include "logging.h"
+#include "output.h"
+#include "priority.h"
+#include "server.h"
+#include "toplevel.h"
+#include "unix_socket.h"
+
+/* Longest request line accepted. Longer requests close the connection */
+#define IPC_MAX_REQUEST (1024 * 1024)
+#define IPC_MAX_CONNECTIONS (16)
+
+struct ipc_connection {
+  struct wl_list link;
+  struct server *server;
+  int fd;
+  struct wl_event_source *source;
+
+  char *in;
+  size_t in_len;
+  size_t in_size;
+
+  char *out;
+  size_t out_len;
+  size_t out_offset;
+
+  /* The peer has stopped sending; close once the output is written */
+  bool closing;
+
+  struct ipc_connection_sig const *sig;
+};
+DECLARE_TYPE(ipc_connection)
+DEFINE_TYPE(ipc_connection)
+
+enum ipc_command_type {
+  IPC_LIST_TOPLEVELS,
+  IPC_CLIENTS,
+  IPC_OUTPUTS,
+  IPC_SCENE,
+  IPC_FOCUS,
+  IPC_CLOSE,
+  IPC_MINIMIZE,
+  IPC_SPAWN,
+  IPC_LOG_LEVEL,
+  IPC_FLUSH_LOG,
+};
+
+static struct {
+  char const *name;
+  enum ipc_command_type type;
+  bool needs_toplevel;
+} const ipc_commands[] = {
+    {"list_toplevels", IPC_LIST_TOPLEVELS, false},
+    {"clients", IPC_CLIENTS, false},
+    {"outputs", IPC_OUTPUTS, false},
+    {"scene", IPC_SCENE, false},
+    {"focus", IPC_FOCUS, true},
+    {"close", IPC_CLOSE, true},
+    {"minimize", IPC_MINIMIZE, true},
+    {"spawn", IPC_SPAWN, false},
+    {"log_level", IPC_LOG_LEVEL, false},
+    {"flush_log", IPC_FLUSH_LOG, false},
+};
+
+/* A validated command, ready to run */
+struct ipc_command {
+  enum ipc_command_type type;
+  struct toplevel *toplevel;
+  char const *cmd;
+  bool set_level;
+  enum wlr_log_importance level;
+};
+
+static void write_string_or_null(FILE *f, char const *s) {
+  if (s) {
+    json_write_string(f, s);
+  } else {
+    fputs("null", f);
+  }
+}
+
+static void write_bool(FILE *f, bool value) {
+  fputs(value ? "true" : "false", f);
+}
+
+static void write_toplevels(struct server *server, FILE *f) {
+  struct wlr_surface *focused = server->seat->keyboard_state.focused_surface;
+  bool first = true;
+
+  fputc('[', f);
+  struct toplevel *toplevel;
+  wl_list_for_each(toplevel, &server->toplevels, link) {
+    struct wlr_xdg_toplevel *xdg_toplevel = toplevel->xdg_toplevel;
+    pid_t pid = 0;
+    wl_client_get_credentials(wl_resource_get_client(xdg_toplevel->resource),
+                              &pid, NULL, NULL);
+
+    if (!first) {
+      fputc(',', f);
+    }
+    first = false;
+
+    fprintf(f, "{\"id\":%" PRIu32 ",\"app_id\":", toplevel->id);
+    write_string_or_null(f, xdg_toplevel->app_id);
+    fputs(",\"title\":", f);
+    write_string_or_null(f, xdg_toplevel->title);
+    fputs(",\"output\":", f);
+    write_string_or_null(
+        f, toplevel->output ? toplevel->output->wlr_output->name : NULL);
+    fprintf(f, ",\"pid\":%d,\"focused\":", (int)pid);
+    write_bool(f, focused && focused == xdg_toplevel->base->surface);
+    fputs(",\"minimized\":", f);
+    write_bool(f, toplevel->minimized);
+    fputs(",\"suspended\":", f);
+    write_bool(f, toplevel->suspended);
+    fputs(",\"fullscreen\":", f);
+    write_bool(f, toplevel->fullscreen);
+    fputs(",\"panel\":", f);
+    write_bool(f, toplevel->output && toplevel->output->panel == toplevel);
+    fprintf(f,
+            ",\"geometry\":{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d}}",
+            toplevel->scene_tree->node.x, toplevel->scene_tree->node.y,
+            xdg_toplevel->base->geometry.width,
+            xdg_toplevel->base->geometry.height);
+  }
+  fputc(']', f);
+}
+
+static void write_clients(struct server *server, FILE *f) {
+  bool first = true;
+
+  fputc('[', f);
+  struct client *client;
+  wl_list_for_each(client, &server->clients, link) {
+    if (!first) {
+      fputc(',', f);
+    }
+    first = false;
+
+    fprintf(f, "{\"pid\":%d,\"app_id\":", (int)client->pid);
+    write_string_or_null(f, client->app_id);
+    fputs(",\"spawned\":", f);
+    write_bool(f, client->spawned);
+    fprintf(f, ",\"commits\":%" PRIu64 ",\"cpu\":", client->commits);
+    json_write_string(f, cpu_class_name(client->cpu_class));
+    fputs(",\"cgroup\":", f);
+    write_string_or_null(f, client->cgroup);
+    fputs(",\"frozen\":", f);
+    write_bool(f, client->frozen);
+    fprintf(f,
+            ",\"surfaces\":%d,\"shm_pools\":%d,\"shm_pool_bytes\":%" PRIu64
+            ",\"shm_buffers\":%d,\"shm_buffer_bytes\":%" PRIu64
+            ",\"shm_over_soft_limit\":",
+            client->shm.surfaces, client->shm.pools, client->shm.pool_bytes,
+            client->shm.buffers, client->shm.buffer_bytes);
+    write_bool(f, client->shm.over_soft_limit);
+    fputc('}', f);
+  }
+  fputc(']', f);
+}
+
+static void write_outputs(struct server *server, FILE *f) {
+  bool first = true;
+
+  fputc('[', f);
+  struct output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct wlr_output_layout_output *l_output =
+        wlr_output_layout_get(server->output_layout, wlr_output);
+
+    if (!first) {
+      fputc(',', f);
+    }
+    first = false;
+
+    fputs("{\"name\":", f);
+    json_write_string(f, wlr_output->name);
+    fprintf(f,
+            ",\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,"
+            "\"refresh\":%.3f,\"scale\":%g,\"enabled\":",
+            l_output ? l_output->x : 0, l_output ? l_output->y : 0,
+            wlr_output->width, wlr_output->height,
+            wlr_output->refresh / 1000.0, wlr_output->scale);
+    write_bool(f, wlr_output->enabled);
+    fprintf(f, ",\"frames\":%" PRIu64 "}", output->stats.frames);
+  }
+  fputc(']', f);
+}
+
+static void write_scene_node(struct wlr_scene_node *node, FILE *f) {
+  fprintf(f, "{\"x\":%d,\"y\":%d,\"enabled\":", node->x, node->y);
+  write_bool(f, node->enabled);
+
+  switch (node->type) {
+  case WLR_SCENE_NODE_TREE: {
+    fputs(",\"type\":\"tree\"", f);
+    /* Only toplevel scene trees have their data set */
+    if (node->data) {
+      struct toplevel *toplevel = check_sig_toplevel(node->data);
+      fprintf(f, ",\"toplevel\":%" PRIu32, toplevel->id);
+    }
+
+    fputs(",\"children\":[", f);
+    struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+    struct wlr_scene_node *child;
+    bool first = true;
+    wl_list_for_each(child, &tree->children, link) {
+      if (!first) {
+        fputc(',', f);
+      }
+      first = false;
+      write_scene_node(child, f);
+    }
+    fputc(']', f);
+    break;
+  }
+
+  case WLR_SCENE_NODE_RECT: {
+    struct wlr_scene_rect *rect = wlr_scene_rect_from_node(node);
+    fprintf(f, ",\"type\":\"rect\",\"width\":%d,\"height\":%d", rect->width,
+            rect->height);
+    break;
+  }
+
+  case WLR_SCENE_NODE_BUFFER: {
+    struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+    int width = buffer->dst_width;
+    int height = buffer->dst_height;
+    if ((!width || !height) && buffer->buffer) {
+      width = buffer->buffer->width;
+      height = buffer->buffer->height;
+    }
+    fprintf(f, ",\"type\":\"buffer\",\"width\":%d,\"height\":%d", width,
+            height);
+    break;
+  }
+  }
+  fputc('}', f);
+}
+
+static bool ipc_parse_command(struct server *server,
+                              struct json_value const *value,
+                              struct ipc_command *command, char *error,
+                              size_t error_size) {
+  char const *name = json_object_get_string(value, "command");
+  if (!name) {
+    snprintf(error, error_size, "missing \"command\"");
+    return false;
+  }
+
+  size_t i;
+  for (i = 0; i < sizeof(ipc_commands) / sizeof(*ipc_commands); i++) {
+    if (strcmp(ipc_commands[i].name, name) == 0) {
+      break;
+    }
+  }
+  if (i == sizeof(ipc_commands) / sizeof(*ipc_commands)) {
+    snprintf(error, error_size, "unknown command \"%s\"", name);
+    return false;
+  }
+  command->type = ipc_commands[i].type;
+
+  if (ipc_commands[i].needs_toplevel) {
+    struct json_value const *id = json_object_get(value, "id");
+    if (!id || id->type != JSON_NUMBER || id->number < 0 ||
+        id->number > UINT32_MAX || id->number != floor(id->number)) {
+      snprintf(error, error_size, "%s: missing or invalid \"id\"", name);
+      return false;
+    }
+    command->toplevel = toplevel_from_id(server, id->number);
+    if (!command->toplevel) {
+      snprintf(error, error_size, "%s: no toplevel with id %.0f", name,
+               id->number);
+      return false;
+    }
+  }
+
+  if (command->type == IPC_LOG_LEVEL && json_object_get(value, "level")) {
+    char const *level = json_object_get_string(value, "level");
+    if (!level || !log_level_from_name(level, &command->level)) {
+      snprintf(error, error_size, "log_level: invalid \"level\"");
+      return false;
+    }
+    command->set_level = true;
+  }
+
+  if (command->type == IPC_SPAWN) {
+    command->cmd = json_object_get_string(value, "cmd");
+    if (!command->cmd || !*command->cmd) {
+      snprintf(error, error_size, "spawn: missing \"cmd\"");
+      return false;
+    }
+  }
+  return true;
+}
+
+static void ipc_run_command(struct server *server,
+                            struct ipc_command const *command, FILE *f) {
+  switch (command->type) {
+  case IPC_LIST_TOPLEVELS:
+    write_toplevels(server, f);
+    break;
+
+  case IPC_CLIENTS:
+    write_clients(server, f);
+    break;
+
+  case IPC_OUTPUTS:
+    write_outputs(server, f);
+    break;
+
+  case IPC_SCENE:
+    write_scene_node(&server->scene->tree.node, f);
+    break;
+
+  case IPC_FOCUS:
+    toplevel_focus(command->toplevel);
+    fputs("null", f);
+    break;
+
+  case IPC_CLOSE:
+    toplevel_close(command->toplevel);
+    fputs("null", f);
+    break;
+
+  case IPC_MINIMIZE:
+    toplevel_set_minimized(command->toplevel, true);
+    fputs("null", f);
+    break;
+
+  case IPC_SPAWN: {
+    /* Launching can only fail once it is attempted, so report it here */
+    struct child *child = child_launch(server, command->cmd, NULL);
+    if (child) {
+      fprintf(f, "{\"pid\":%d}", (int)child->pid);
+    } else {
+      fputs("{\"error\":\"unable to launch\"}", f);
+    }
+    break;
+  }
+
+  case IPC_LOG_LEVEL:
+    if (command->set_level) {
+      log_set_level(command->level);
+    }
+    fputs("{\"level\":", f);
+    json_write_string(f, log_level_name(log_get_level()));
+    fputc('}', f);
+    break;
+
+  case IPC_FLUSH_LOG:
+    log_ring_flush(STDERR_FILENO);
+    fputs("null", f);
+    break;
+  }
+}
+
+static void write_error(FILE *f, char const *error) {
+  fputs("{\"success\":false,\"error\":", f);
+  json_write_string(f, error);
+  fputs("}\n", f);
+}
+
+static void ipc_handle_request(struct server *server, char const *line,
+                               FILE *f) {
+  char const *parse_error;
+  struct json_value *request = json_parse(line, &parse_error);
+  if (!request) {
+    char error[256];
+    snprintf(error, sizeof(error), "invalid JSON: %s", parse_error);
+    write_error(f, error);
+    return;
+  }
+
+  bool batch = request->type == JSON_ARRAY;
+  struct json_value *const *items = batch ? request->array.items : &request;
+  size_t len = batch ? request->array.len : 1;
+
+  /* Validate everything first so that a bad batch changes nothing */
+  struct ipc_command *commands = calloc(len ? len : 1, sizeof(*commands));
+  for (size_t i = 0; i < len; i++) {
+    char error[256];
+    if (ipc_parse_command(server, items[i], &commands[i], error,
+                          sizeof(error))) {
+      continue;
+    }
+
+    if (batch) {
+      char batch_error[300];
+      snprintf(batch_error, sizeof(batch_error), "command %zu: %s", i, error);
+      write_error(f, batch_error);
+    } else {
+      write_error(f, error);
+    }
+    goto out;
+  }
+
+  fputs(batch ? "{\"success\":true,\"results\":["
+              : "{\"success\":true,\"result\":",
+        f);
+  for (size_t i = 0; i < len; i++) {
+    if (i) {
+      fputc(',', f);
+    }
+    ipc_run_command(server, &commands[i], f);
+  }
+  fputs(batch ? "]}\n" : "}\n", f);
+
+out:
+  free(commands);
+  json_free(request);
+}
+
+static void ipc_connection_destroy(struct ipc_connection *conn) {
+  wl_event_source_remove(conn->source);
+  close(conn->fd);
+  wl_list_remove(&conn->link);
+  conn->server->ipc.num_connections--;
+  free(conn->in);
+  free(conn->out);
+  free(conn);
+}
+
+/* Returns false if the connection failed */
+static bool ipc_connection_flush(struct ipc_connection *conn) {
+  while (conn->out_offset < conn->out_len) {
+    ssize_t ret =
+        send(conn->fd, conn->out + conn->out_offset,
+             conn->out_len - conn->out_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    conn->out_offset += ret;
+  }
+
+  free(conn->out);
+  conn->out = NULL;
+  conn->out_len = 0;
+  conn->out_offset = 0;
+  return true;
+}
+
+/*
+ * Handle every complete request line in the input buffer. Responses are
+ * buffered and the connection stops reading until they have been written, so
+ * a client that doesn't read its responses can't make the compositor buffer
+ * without bound.
+ */
+static void ipc_connection_process(struct ipc_connection *conn) {
+  FILE *f = open_memstream(&conn->out, &conn->out_len);
+  if (!f) {
+    conn->closing = true;
+    return;
+  }
+
+  char *start = conn->in;
+  char *end = conn->in + conn->in_len;
+  char *newline;
+  while ((newline = memchr(start, '\n', end - start))) {
+    *newline = '\0';
+    if (strlen(start) != (size_t)(newline - start)) {
+      write_error(f, "invalid request");
+    } else if (start[strspn(start, " \t\r")]) {
+      ipc_handle_request(conn->server, start, f);
+    }
+    start = newline + 1;
+  }
+
+  conn->in_len = end - start;
+  memmove(conn->in, start, conn->in_len);
+
+  if (conn->in_len >= IPC_MAX_REQUEST) {
+    write_error(f, "request too long");
+    conn->closing = true;
+  }
+  fclose(f);
+}
+
+static int ipc_connection_event(int fd, uint32_t mask, void *data) {
+  struct ipc_connection *conn = check_sig_ipc_connection(data);
+  watchdog_mark("ipc.connection");
+
+  if (mask & WL_EVENT_ERROR) {
+    ipc_connection_destroy(conn);
+    return 0;
+  }
+
+  if (conn->out_len == 0 && !conn->closing) {
+    if (conn->in_size - conn->in_len < 4096 &&
+        conn->in_size < IPC_MAX_REQUEST) {
+      conn->in_size = conn->in_size ? conn->in_size * 2 : 4096;
+      conn->in = realloc(conn->in, conn->in_size);
+    }
+
+    ssize_t ret = recv(conn->fd, conn->in + conn->in_len,
+                       conn->in_size - conn->in_len, MSG_DONTWAIT);
+    if (ret > 0) {
+      conn->in_len += ret;
+      ipc_connection_process(conn);
+    } else if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                            errno != EINTR)) {
+      conn->closing = true;
+    }
+  } else if (mask & WL_EVENT_HANGUP) {
+    ipc_connection_destroy(conn);
+    return 0;
+  }
+
+  if (!ipc_connection_flush(conn) || (conn->closing && conn->out_len == 0)) {
+    ipc_connection_destroy(conn);
+    return 0;
+  }
+
+  wl_event_source_fd_update(conn->source, conn->out_len ? WL_EVENT_WRITABLE
+                                                        : WL_EVENT_READABLE);
+  return 0;
+}
+
+static int ipc_accept(int fd, uint32_t mask, void *data) {
+  struct server *server = check_sig_server(data);
+  watchdog_mark("ipc.accept");
+
+  int conn_fd;
+  while ((conn_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >=
+         0) {
+    if (server->ipc.num_connections >= IPC_MAX_CONNECTIONS) {
+      wlr_log(WLR_ERROR, "Too many IPC connections");
+      close(conn_fd);
+      continue;
+    }
+
+    struct ipc_connection *conn = alloc_ipc_connection();
+    conn->server = server;
+    conn->fd = conn_fd;
+    conn->source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(server->wl_display), conn_fd,
+        WL_EVENT_READABLE, ipc_connection_event, conn);
+    if (!conn->source) {
+      close(conn_fd);
+      free(conn);
+      continue;
+    }
+    wl_list_insert(&server->ipc.connections, &conn->link);
+    server->ipc.num_connections++;
+  }
+  return 0;
+}
+
+bool ipc_init(struct server *server, char const *path) {
+  wl_list_init(&server->ipc.connections);
+  server->ipc.fd = -1;
+
+  int fd = unix_socket_listen(path, IPC_MAX_CONNECTIONS);
+  if (fd < 0) {
+    return false;
+  }
+
+  server->ipc.source =
+      wl_event_loop_add_fd(wl_display_get_event_loop(server->wl_display), fd,
+                           WL_EVENT_READABLE, ipc_accept, server);
+  if (!server->ipc.source) {
+    close(fd);
+    unlink(path);
+    return false;
+  }
+  server->ipc.fd = fd;
+  server->ipc.path = strdup(path);
+
+  wlr_log(WLR_INFO, "Listening for IPC on %s", path);
+  return true;
+}
+
+void ipc_finish(struct server *server) {
+  if (server->ipc.fd < 0) {
+    return;
+  }
+
+  struct ipc_connection *conn, *tmp;
+  wl_list_for_each_safe(conn, tmp, &server->ipc.connections, link) {
+    ipc_connection_destroy(conn);
+  }
+  wl_event_source_remove(server->ipc.source);
+  close(server->ipc.fd);
+  unlink(server->ipc.path);
+  free(server->ipc.path);
+  server->ipc.fd = -1;
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _IPC_H
+#define _IPC_H
+
+#include <stdbool.h>
+
+struct server;
+
+/*
+ * Control socket. Clients send newline delimited JSON requests, each either a
+ * single command object or an array of commands, and get one JSON response
+ * line per request. All the commands of a request are validated before any
+ * of them is run, so a batch either runs completely or not at all.
+ */
+bool ipc_init(struct server *server, char const *path);
+void ipc_finish(struct server *server);
+
+#endif
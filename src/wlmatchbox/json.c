@@ -0,0 +1,437 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "json.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Deeper documents are rejected so parsing can't exhaust the stack */
+#define JSON_MAX_DEPTH (32)
+
+struct parser {
+  char const *p;
+  char const *error;
+  int depth;
+};
+
+static struct json_value *parse_value(struct parser *parser);
+
+static void skip_space(struct parser *parser) {
+  while (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' ||
+         *parser->p == '\r') {
+    parser->p++;
+  }
+}
+
+static struct json_value *new_value(enum json_type type) {
+  struct json_value *value = calloc(1, sizeof(*value));
+  value->type = type;
+  return value;
+}
+
+static void append(void *array_ptr, size_t *len, void *item) {
+  void ***array = array_ptr;
+  /* Grow in powers of two */
+  if ((*len & (*len - 1)) == 0) {
+    *array = realloc(*array, (*len ? *len * 2 : 1) * sizeof(void *));
+  }
+  (*array)[(*len)++] = item;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static bool parse_hex4(struct parser *parser, uint32_t *out) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_value(parser->p[i]);
+    if (digit < 0) {
+      parser->error = "invalid unicode escape";
+      return false;
+    }
+    value = value << 4 | digit;
+  }
+  parser->p += 4;
+  *out = value;
+  return true;
+}
+
+static size_t encode_utf8(uint32_t c, char *out) {
+  if (c < 0x80) {
+    out[0] = c;
+    return 1;
+  }
+  if (c < 0x800) {
+    out[0] = 0xc0 | c >> 6;
+    out[1] = 0x80 | (c & 0x3f);
+    return 2;
+  }
+  if (c < 0x10000) {
+    out[0] = 0xe0 | c >> 12;
+    out[1] = 0x80 | (c >> 6 & 0x3f);
+    out[2] = 0x80 | (c & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | c >> 18;
+  out[1] = 0x80 | (c >> 12 & 0x3f);
+  out[2] = 0x80 | (c >> 6 & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+  return 4;
+}
+
+static char *parse_string(struct parser *parser) {
+  /* Escapes never make a string longer, so the input length is enough */
+  char const *end = parser->p + 1;
+  while (*end && *end != '"') {
+    if (*end == '\\' && end[1]) {
+      end++;
+    }
+    end++;
+  }
+  if (!*end) {
+    parser->error = "unterminated string";
+    return NULL;
+  }
+
+  char *s = malloc(end - parser->p);
+  size_t len = 0;
+  parser->p++;
+  while (*parser->p != '"') {
+    char c = *parser->p++;
+    if ((unsigned char)c < 0x20) {
+      parser->error = "control character in string";
+      free(s);
+      return NULL;
+    }
+    if (c != '\\') {
+      s[len++] = c;
+      continue;
+    }
+
+    c = *parser->p++;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      s[len++] = c;
+      break;
+    case 'b':
+      s[len++] = '\b';
+      break;
+    case 'f':
+      s[len++] = '\f';
+      break;
+    case 'n':
+      s[len++] = '\n';
+      break;
+    case 'r':
+      s[len++] = '\r';
+      break;
+    case 't':
+      s[len++] = '\t';
+      break;
+    case 'u': {
+      uint32_t code;
+      if (!parse_hex4(parser, &code)) {
+        free(s);
+        return NULL;
+      }
+      if (code >= 0xd800 && code < 0xdc00 && parser->p[0] == '\\' &&
+          parser->p[1] == 'u') {
+        uint32_t low;
+        parser->p += 2;
+        if (!parse_hex4(parser, &low)) {
+          free(s);
+          return NULL;
+        }
+        if (low >= 0xdc00 && low < 0xe000) {
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        } else {
+          code = 0xfffd;
+        }
+      } else if (code >= 0xd800 && code < 0xe000) {
+        code = 0xfffd;
+      }
+      if (code == 0) {
+        parser->error = "NUL in string";
+        free(s);
+        return NULL;
+      }
+      len += encode_utf8(code, s + len);
+      break;
+    }
+    default:
+      parser->error = "invalid escape";
+      free(s);
+      return NULL;
+    }
+  }
+  parser->p++;
+  s[len] = '\0';
+  return s;
+}
+
+static struct json_value *parse_array(struct parser *parser) {
+  struct json_value *value = new_value(JSON_ARRAY);
+  parser->p++;
+  skip_space(parser);
+  if (*parser->p == ']') {
+    parser->p++;
+    return value;
+  }
+
+  while (true) {
+    struct json_value *item = parse_value(parser);
+    if (!item) {
+      json_free(value);
+      return NULL;
+    }
+    append(&value->array.items, &value->array.len, item);
+
+    skip_space(parser);
+    if (*parser->p == ',') {
+      parser->p++;
+    } else if (*parser->p == ']') {
+      parser->p++;
+      return value;
+    } else {
+      parser->error = "expected ',' or ']'";
+      json_free(value);
+      return NULL;
+    }
+  }
+}
+
+static struct json_value *parse_object(struct parser *parser) {
+  struct json_value *value = new_value(JSON_OBJECT);
+  parser->p++;
+  skip_space(parser);
+  if (*parser->p == '}') {
+    parser->p++;
+    return value;
+  }
+
+  while (true) {
+    skip_space(parser);
+    if (*parser->p != '"') {
+      parser->error = "expected object key";
+      json_free(value);
+      return NULL;
+    }
+    char *key = parse_string(parser);
+    if (!key) {
+      json_free(value);
+      return NULL;
+    }
+    skip_space(parser);
+    if (*parser->p != ':') {
+      parser->error = "expected ':'";
+      free(key);
+      json_free(value);
+      return NULL;
+    }
+    parser->p++;
+
+    struct json_value *item = parse_value(parser);
+    if (!item) {
+      free(key);
+      json_free(value);
+      return NULL;
+    }
+    size_t len = value->object.len;
+    append(&value->object.keys, &len, key);
+    append(&value->object.values, &value->object.len, item);
+
+    skip_space(parser);
+    if (*parser->p == ',') {
+      parser->p++;
+    } else if (*parser->p == '}') {
+      parser->p++;
+      return value;
+    } else {
+      parser->error = "expected ',' or '}'";
+      json_free(value);
+      return NULL;
+    }
+  }
+}
+
+static struct json_value *parse_number(struct parser *parser) {
+  char *end;
+  double number = strtod(parser->p, &end);
+  if (end == parser->p) {
+    parser->error = "invalid value";
+    return NULL;
+  }
+  parser->p = end;
+  struct json_value *value = new_value(JSON_NUMBER);
+  value->number = number;
+  return value;
+}
+
+static bool parse_literal(struct parser *parser, char const *literal) {
+  size_t len = strlen(literal);
+  if (strncmp(parser->p, literal, len) != 0) {
+    parser->error = "invalid value";
+    return false;
+  }
+  parser->p += len;
+  return true;
+}
+
+static struct json_value *parse_value(struct parser *parser) {
+  struct json_value *value = NULL;
+
+  skip_space(parser);
+  if (++parser->depth > JSON_MAX_DEPTH) {
+    parser->error = "nested too deeply";
+    return NULL;
+  }
+
+  switch (*parser->p) {
+  case '{':
+    value = parse_object(parser);
+    break;
+  case '[':
+    value = parse_array(parser);
+    break;
+  case '"': {
+    char *s = parse_string(parser);
+    if (s) {
+      value = new_value(JSON_STRING);
+      value->string = s;
+    }
+    break;
+  }
+  case 't':
+  case 'f': {
+    bool boolean = *parser->p == 't';
+    if (parse_literal(parser, boolean ? "true" : "false")) {
+      value = new_value(JSON_BOOL);
+      value->boolean = boolean;
+    }
+    break;
+  }
+  case 'n':
+    if (parse_literal(parser, "null")) {
+      value = new_value(JSON_NULL);
+    }
+    break;
+  default:
+    value = parse_number(parser);
+    break;
+  }
+
+  parser->depth--;
+  return value;
+}
+
+struct json_value *json_parse(char const *text, char const **error) {
+  struct parser parser = {.p = text};
+  struct json_value *value = parse_value(&parser);
+  if (value) {
+    skip_space(&parser);
+    if (*parser.p) {
+      parser.error = "trailing characters";
+      json_free(value);
+      value = NULL;
+    }
+  }
+  if (!value && error) {
+    *error = parser.error;
+  }
+  return value;
+}
+
+void json_free(struct json_value *value) {
+  if (!value) {
+    return;
+  }
+  switch (value->type) {
+  case JSON_STRING:
+    free(value->string);
+    break;
+  case JSON_ARRAY:
+    for (size_t i = 0; i < value->array.len; i++) {
+      json_free(value->array.items[i]);
+    }
+    free(value->array.items);
+    break;
+  case JSON_OBJECT:
+    for (size_t i = 0; i < value->object.len; i++) {
+      free(value->object.keys[i]);
+      json_free(value->object.values[i]);
+    }
+    free(value->object.keys);
+    free(value->object.values);
+    break;
+  default:
+    break;
+  }
+  free(value);
+}
+
+struct json_value const *json_object_get(struct json_value const *object,
+                                         char const *key) {
+  if (!object || object->type != JSON_OBJECT) {
+    return NULL;
+  }
+  for (size_t i = 0; i < object->object.len; i++) {
+    if (strcmp(object->object.keys[i], key) == 0) {
+      return object->object.values[i];
+    }
+  }
+  return NULL;
+}
+
+char const *json_object_get_string(struct json_value const *object,
+                                   char const *key) {
+  struct json_value const *value = json_object_get(object, key);
+  return value && value->type == JSON_STRING ? value->string : NULL;
+}
+
+void json_write_string(FILE *f, char const *s) {
+  fputc('"', f);
+  for (; s && *s; s++) {
+    unsigned char c = *s;
+    switch (c) {
+    case '"':
+      fputs("\\\"", f);
+      break;
+    case '\\':
+      fputs("\\\\", f);
+      break;
+    case '\n':
+      fputs("\\n", f);
+      break;
+    case '\r':
+      fputs("\\r", f);
+      break;
+    case '\t':
+      fputs("\\t", f);
+      break;
+    default:
+      if (c < 0x20) {
+        fprintf(f, "\\u%04x", c);
+      } else {
+        fputc(c, f);
+      }
+      break;
+    }
+  }
+  fputc('"', f);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Minimal JSON support for the IPC: a DOM parser and string escaping */
+
+enum json_type {
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT,
+};
+
+struct json_value {
+  enum json_type type;
+  union {
+    bool boolean;
+    double number;
+    char *string;
+    struct {
+      struct json_value **items;
+      size_t len;
+    } array;
+    struct {
+      char **keys;
+      struct json_value **values;
+      size_t len;
+    } object;
+  };
+};
+
+/*
+ * Parse a complete JSON document. Returns NULL and sets error to a static
+ * string if it is not valid.
+ */
+struct json_value *json_parse(char const *text, char const **error);
+void json_free(struct json_value *value);
+
+struct json_value const *json_object_get(struct json_value const *object,
+                                         char const *key);
+char const *json_object_get_string(struct json_value const *object,
+                                   char const *key);
+
+void json_write_string(FILE *f, char const *s);
+
+#endif
@@ -9,7 +9,10 @@
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_seat.h>
 
+#include "keymap.h"
+#include "probes.h"
 #include "server.h"
+#include "trace.h"
 
 DEFINE_TYPE(keyboard)
 
@@ -28,13 +31,22 @@ static void keyboard_handle_key(struct wl_listener *listener, void *data) {
   struct server *server = keyboard->server;
   struct wlr_keyboard_key_event *event = data;
   struct wlr_seat *seat = server->seat;
+  int64_t trace_start = trace_begin();
+  PROBE3(key, event->keycode, event->state, event->time_msec);
+  server->stats.key_events++;
 
   /* Translate libinput keycode -> xkbcommon */
   uint32_t keycode = event->keycode + 8;
-  /* Get a list of keysyms based on the keymap for this keyboard */
+  /*
+   * Get a list of keysyms based on the keymap for this keyboard. There is no
+   * keymap (and no state) until it has finished compiling
+   */
   const xkb_keysym_t *syms;
-  int nsyms =
-      xkb_state_key_get_syms(keyboard->wlr_keyboard->xkb_state, keycode, &syms);
+  int nsyms = 0;
+  if (keyboard->wlr_keyboard->xkb_state) {
+    nsyms = xkb_state_key_get_syms(keyboard->wlr_keyboard->xkb_state, keycode,
+                                   &syms);
+  }
 
   bool handled = false;
   uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->wlr_keyboard);
@@ -53,6 +65,7 @@ static void keyboard_handle_key(struct wl_listener *listener, void *data) {
     wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode,
                                  event->state);
   }
+  trace_end("input", "key", trace_start, "keycode", event->keycode);
 }
 
 static void keyboard_handle_destroy(struct wl_listener *listener, void *data) {
@@ -65,25 +78,47 @@ static void keyboard_handle_destroy(struct wl_listener *listener, void *data) {
   wl_list_remove(&keyboard->modifiers.link);
   wl_list_remove(&keyboard->key.link);
   wl_list_remove(&keyboard->destroy.link);
+  if (keyboard->keymap) {
+    wl_list_remove(&keyboard->keymap_ready.link);
+  }
   wl_list_remove(&keyboard->link);
   free(keyboard);
 }
 
+static void keyboard_set_keymap(struct keyboard *keyboard,
+                                struct keymap *keymap) {
+  if (keymap->xkb_keymap) {
+    wlr_keyboard_set_keymap(keyboard->wlr_keyboard, keymap->xkb_keymap);
+  }
+}
+
+static void keyboard_handle_keymap_ready(struct wl_listener *listener,
+                                         void *data) {
+  struct keyboard *keyboard =
+      get_type_ptr(keyboard, listener, keyboard, keymap_ready);
+  struct keymap *keymap = keyboard->keymap;
+
+  wl_list_remove(&keyboard->keymap_ready.link);
+  keyboard->keymap = NULL;
+  keyboard_set_keymap(keyboard, keymap);
+}
+
 void keyboard_create(struct server *server, struct wlr_input_device *device) {
   struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device(device);
   struct keyboard *keyboard = alloc_keyboard();
   keyboard->server = server;
   keyboard->wlr_keyboard = wlr_keyboard;
 
-  /* We need to prepare an XKB keymap and assign it to the keyboard. This
-   * assumes the defaults (e.g. layout = "us"). */
-  struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-  struct xkb_keymap *keymap =
-      xkb_keymap_new_from_names(context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-  wlr_keyboard_set_keymap(wlr_keyboard, keymap);
-  xkb_keymap_unref(keymap);
-  xkb_context_unref(context);
+  /* Keymaps are shared between keyboards. If the configured one is still
+   * being compiled, it is assigned to the keyboard once it is ready */
+  struct keymap *keymap = keymap_get(server, &server->options.xkb);
+  if (keymap->compiling) {
+    keyboard->keymap = keymap;
+    bind_clbk(&keyboard->keymap_ready, &keymap->events.ready,
+              keyboard_handle_keymap_ready);
+  } else {
+    keyboard_set_keymap(keyboard, keymap);
+  }
   wlr_keyboard_set_repeat_info(wlr_keyboard, 25, 600);
 
   /* Here we set up listeners for keyboard events. */
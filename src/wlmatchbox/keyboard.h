@@ -16,10 +16,12 @@ struct keyboard {
   struct wl_list link;
   struct server *server;
   struct wlr_keyboard *wlr_keyboard;
+  struct keymap *keymap;
 
   struct wl_listener modifiers;
   struct wl_listener key;
   struct wl_listener destroy;
+  struct wl_listener keymap_ready;
 
   struct keyboard_sig const *sig;
 };
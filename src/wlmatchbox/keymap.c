@@ -0,0 +1,209 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "keymap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+#include "server.h"
+
+DEFINE_TYPE(keymap)
+
+/*
+ * A compile job. The worker thread only reads the names from the (immutable)
+ * cache entry and fills in the result, then hands the job back to the main
+ * thread through the notify pipe.
+ */
+struct keymap_job {
+  struct keymap *keymap;
+  struct xkb_keymap *result;
+  int notify_fd;
+};
+
+static char *resolve_name(char const *name, char const *env) {
+  if (!name || !*name) {
+    name = getenv(env);
+  }
+  return strdup(name ? name : "");
+}
+
+static char const *name_or_null(char const *name) {
+  return *name ? name : NULL;
+}
+
+static struct xkb_keymap *keymap_compile(struct keymap const *keymap) {
+  /*
+   * xkb_context is not thread safe, so each compile uses its own. The names
+   * are already resolved against the environment, so don't let xkbcommon look
+   * at it again
+   */
+  struct xkb_context *context =
+      xkb_context_new(XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+  if (!context) {
+    return NULL;
+  }
+
+  struct xkb_rule_names names = {
+      .rules = name_or_null(keymap->rules),
+      .model = name_or_null(keymap->model),
+      .layout = name_or_null(keymap->layout),
+      .variant = name_or_null(keymap->variant),
+      .options = name_or_null(keymap->options),
+  };
+  struct xkb_keymap *xkb_keymap =
+      xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  xkb_context_unref(context);
+  return xkb_keymap;
+}
+
+static void *keymap_compile_thread(void *data) {
+  struct keymap_job *job = data;
+
+  job->result = keymap_compile(job->keymap);
+
+  /* Pointer sized writes to a pipe are atomic */
+  ssize_t ret;
+  do {
+    ret = write(job->notify_fd, &job, sizeof(job));
+  } while (ret < 0 && errno == EINTR);
+  return NULL;
+}
+
+static void keymap_log_result(struct keymap *keymap) {
+  if (keymap->xkb_keymap) {
+    wlr_log(WLR_INFO,
+            "Compiled keymap rules='%s' model='%s' layout='%s' "
+            "variant='%s' options='%s' in %.1f ms",
+            keymap->rules, keymap->model, keymap->layout, keymap->variant,
+            keymap->options, (double)keymap->compile_nsec / NSEC_PER_MSEC);
+  } else {
+    wlr_log(WLR_ERROR,
+            "Failed to compile keymap rules='%s' model='%s' layout='%s' "
+            "variant='%s' options='%s'",
+            keymap->rules, keymap->model, keymap->layout, keymap->variant,
+            keymap->options);
+  }
+}
+
+static int keymap_notify(int fd, uint32_t mask, void *data) {
+  struct keymap_job *job;
+  watchdog_mark("keymap.ready");
+
+  while (read(fd, &job, sizeof(job)) == sizeof(job)) {
+    struct keymap *keymap = check_sig_keymap(job->keymap);
+    keymap->xkb_keymap = job->result;
+    keymap->compiling = false;
+    keymap->compile_nsec = get_time_nsec() - keymap->compile_nsec;
+    free(job);
+
+    keymap_log_result(keymap);
+    wl_signal_emit_mutable(&keymap->events.ready, keymap);
+  }
+  return 0;
+}
+
+static bool keymap_start_compile(struct keymap *keymap) {
+  struct keymap_job *job = calloc(1, sizeof(*job));
+  job->keymap = keymap;
+  job->notify_fd = keymap->server->keymap_pipe[1];
+
+  /*
+   * Signals are handled through a signalfd on the main thread, which only
+   * works if no other thread can receive them
+   */
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_t thread;
+  int ret = pthread_create(&thread, &attr, keymap_compile_thread, job);
+  pthread_attr_destroy(&attr);
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (ret != 0) {
+    wlr_log(WLR_ERROR, "Unable to start keymap compile thread: %s",
+            strerror(ret));
+    free(job);
+    return false;
+  }
+
+  keymap->compiling = true;
+  keymap->compile_nsec = get_time_nsec();
+  return true;
+}
+
+struct keymap *keymap_get(struct server *server,
+                          struct xkb_rule_names const *names) {
+  struct keymap *keymap = alloc_keymap();
+  keymap->server = server;
+  keymap->rules = resolve_name(names->rules, "XKB_DEFAULT_RULES");
+  keymap->model = resolve_name(names->model, "XKB_DEFAULT_MODEL");
+  keymap->layout = resolve_name(names->layout, "XKB_DEFAULT_LAYOUT");
+  keymap->variant = resolve_name(names->variant, "XKB_DEFAULT_VARIANT");
+  keymap->options = resolve_name(names->options, "XKB_DEFAULT_OPTIONS");
+
+  struct keymap *k;
+  wl_list_for_each(k, &server->keymaps, link) {
+    if (strcmp(k->rules, keymap->rules) == 0 &&
+        strcmp(k->model, keymap->model) == 0 &&
+        strcmp(k->layout, keymap->layout) == 0 &&
+        strcmp(k->variant, keymap->variant) == 0 &&
+        strcmp(k->options, keymap->options) == 0) {
+      free(keymap->rules);
+      free(keymap->model);
+      free(keymap->layout);
+      free(keymap->variant);
+      free(keymap->options);
+      free(keymap);
+      return k;
+    }
+  }
+
+  wl_signal_init(&keymap->events.ready);
+  wl_list_insert(&server->keymaps, &keymap->link);
+
+  if (!keymap_start_compile(keymap)) {
+    /* Fall back to compiling on the main thread */
+    keymap->compile_nsec = get_time_nsec();
+    keymap->xkb_keymap = keymap_compile(keymap);
+    keymap->compile_nsec = get_time_nsec() - keymap->compile_nsec;
+    keymap_log_result(keymap);
+  }
+
+  return keymap;
+}
+
+bool keymap_init(struct server *server) {
+  wl_list_init(&server->keymaps);
+
+  if (pipe2(server->keymap_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to create keymap pipe");
+    return false;
+  }
+
+  server->keymap_source = wl_event_loop_add_fd(
+      wl_display_get_event_loop(server->wl_display), server->keymap_pipe[0],
+      WL_EVENT_READABLE, keymap_notify, server);
+  if (!server->keymap_source) {
+    wlr_log(WLR_ERROR, "Unable to watch keymap pipe");
+    return false;
+  }
+
+  /* Start compiling the configured keymap before any keyboard shows up */
+  keymap_get(server, &server->options.xkb);
+  return true;
+}
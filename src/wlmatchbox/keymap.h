@@ -0,0 +1,47 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _KEYMAP_H
+#define _KEYMAP_H
+
+#include <wayland-server.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "util.h"
+
+struct server;
+
+/*
+ * A compiled keymap, shared by every keyboard that uses the same RMLVO names.
+ * Keymaps are compiled on a worker thread; until that finishes xkb_keymap is
+ * NULL and the ready signal is emitted once it is done (successfully or not).
+ */
+struct keymap {
+  struct wl_list link;
+  struct server *server;
+
+  char *rules;
+  char *model;
+  char *layout;
+  char *variant;
+  char *options;
+
+  struct xkb_keymap *xkb_keymap;
+  bool compiling;
+  int64_t compile_nsec;
+
+  struct {
+    struct wl_signal ready;
+  } events;
+
+  struct keymap_sig const *sig;
+};
+DECLARE_TYPE(keymap)
+
+bool keymap_init(struct server *server);
+struct keymap *keymap_get(struct server *server,
+                          struct xkb_rule_names const *names);
+
+#endif
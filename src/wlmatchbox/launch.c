@@ -0,0 +1,216 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "launch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wordexp.h>
+
+extern char **environ;
+
+static bool env_matches(char const *var, char const *override) {
+  size_t len = strcspn(var, "=");
+  return strncmp(var, override, len) == 0 && override[len] == '=';
+}
+
+static bool env_overridden(char const *var, char const *const *env,
+                           char const *extra) {
+  if (extra && env_matches(var, extra)) {
+    return true;
+  }
+  for (; env && *env; env++) {
+    if (env_matches(var, *env)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Build the environment for the child from environ, the caller's overrides and
+ * one extra variable set by the launcher itself, which wins over both. The
+ * strings are shared, only the array is allocated.
+ */
+static char **build_env(char const *const *env, char const *extra) {
+  size_t count = 0;
+  for (char **e = environ; *e; e++) {
+    count++;
+  }
+  for (char const *const *e = env; e && *e; e++) {
+    count++;
+  }
+
+  char **envp = calloc(count + 2, sizeof(*envp));
+  if (!envp) {
+    return NULL;
+  }
+
+  size_t i = 0;
+  for (char **e = environ; *e; e++) {
+    if (!env_overridden(*e, env, extra)) {
+      envp[i++] = *e;
+    }
+  }
+  for (char const *const *e = env; e && *e; e++) {
+    if (!env_overridden(*e, NULL, extra)) {
+      envp[i++] = (char *)*e;
+    }
+  }
+  if (extra) {
+    envp[i++] = (char *)extra;
+  }
+  return envp;
+}
+
+#ifndef POSIX_SPAWN_SETCGROUP
+static void move_to_cgroup(pid_t pid, char const *cgroup) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0 || dprintf(fd, "%d", (int)pid) < 0) {
+    fprintf(stderr, "Unable to move %d to %s: %s\n", (int)pid, cgroup,
+            strerror(errno));
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+#endif
+
+pid_t launch_argv(char *const argv[], struct launch_options const *options) {
+  static struct launch_options const default_options = {
+      .wayland_socket = -1,
+  };
+  if (!options) {
+    options = &default_options;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  char **envp = NULL;
+  char wayland_socket_env[32];
+  char const *extra = NULL;
+  int socket_fd = -1;
+  int cgroup_fd = -1;
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  pid_t pid = -1;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  if (options->wayland_socket >= 0) {
+    /*
+     * The socket is close-on-exec in the compositor, so it has to be dup'd
+     * to a known descriptor in the child. dup2() onto the same number doesn't
+     * clear close-on-exec everywhere, so move it out of the way first
+     */
+    socket_fd = options->wayland_socket;
+    if (socket_fd == LAUNCH_WAYLAND_SOCKET_FD) {
+      socket_fd = fcntl(socket_fd, F_DUPFD_CLOEXEC,
+                        LAUNCH_WAYLAND_SOCKET_FD + 1);
+      if (socket_fd < 0) {
+        fprintf(stderr, "Unable to duplicate socket: %s\n", strerror(errno));
+        goto out;
+      }
+    }
+    posix_spawn_file_actions_adddup2(&actions, socket_fd,
+                                     LAUNCH_WAYLAND_SOCKET_FD);
+    snprintf(wayland_socket_env, sizeof(wayland_socket_env),
+             "WAYLAND_SOCKET=%d", LAUNCH_WAYLAND_SOCKET_FD);
+    extra = wayland_socket_env;
+  }
+
+  /*
+   * The compositor blocks the signals it handles through the event loop, and
+   * the child must not inherit that
+   */
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigfillset(&signals);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+
+#ifdef POSIX_SPAWN_SETCGROUP
+  /*
+   * Start the child directly in its cgroup (clone3() with CLONE_INTO_CGROUP),
+   * so that nothing it starts can escape into the compositor's
+   */
+  if (options->cgroup) {
+    cgroup_fd = open(options->cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup_fd < 0) {
+      fprintf(stderr, "Unable to open %s: %s\n", options->cgroup,
+              strerror(errno));
+      goto out;
+    }
+    posix_spawnattr_setcgroup_np(&attr, cgroup_fd);
+    flags |= POSIX_SPAWN_SETCGROUP;
+  }
+#endif
+  posix_spawnattr_setflags(&attr, flags);
+
+  envp = build_env(options->env, extra);
+  if (!envp) {
+    fprintf(stderr, "Unable to allocate environment\n");
+    goto out;
+  }
+
+  int ret = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp);
+  if (ret != 0) {
+    fprintf(stderr, "Unable to spawn %s: %s\n", argv[0], strerror(ret));
+    pid = -1;
+    goto out;
+  }
+#ifndef POSIX_SPAWN_SETCGROUP
+  if (options->cgroup) {
+    /* Without C library support the child is moved once it is running */
+    move_to_cgroup(pid, options->cgroup);
+  }
+#endif
+
+out:
+  free(envp);
+  if (cgroup_fd >= 0) {
+    close(cgroup_fd);
+  }
+  if (socket_fd >= 0 && socket_fd != options->wayland_socket) {
+    close(socket_fd);
+  }
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  return pid;
+}
+
+pid_t launch_command(char const *command,
+                     struct launch_options const *options) {
+  wordexp_t words;
+  int ret = wordexp(command, &words, WRDE_NOCMD);
+  if (ret != 0) {
+    fprintf(stderr, "Unable to parse command '%s' (%d)\n", command, ret);
+    if (ret == WRDE_NOSPACE) {
+      wordfree(&words);
+    }
+    return -1;
+  }
+
+  pid_t pid = -1;
+  if (words.we_wordc > 0) {
+    pid = launch_argv(words.we_wordv, options);
+  } else {
+    fprintf(stderr, "Empty command\n");
+  }
+
+  wordfree(&words);
+  return pid;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _LAUNCH_H
+#define _LAUNCH_H
+
+#include <sys/types.h>
+
+/* File descriptor number a preconnected Wayland socket is passed on */
+#define LAUNCH_WAYLAND_SOCKET_FD (3)
+
+struct launch_options {
+  /* NULL terminated list of "NAME=VALUE" strings added to the environment */
+  char const *const *env;
+  /* Connected socket to pass to the child as WAYLAND_SOCKET, or -1 */
+  int wayland_socket;
+  /* cgroup v2 directory to start the child in, or NULL */
+  char const *cgroup;
+};
+
+/*
+ * Start a program without forking the compositor. The command is split into
+ * arguments with shell word expansion (but no command substitution) and
+ * looked up in PATH. Returns the pid of the child, or -1 on error.
+ */
+pid_t launch_command(char const *command, struct launch_options const *options);
+pid_t launch_argv(char *const argv[], struct launch_options const *options);
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "logging.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+struct log_entry {
+  /* Index of the entry plus one once complete, 0 while it is being written */
+  atomic_uint_fast64_t seq;
+  int64_t nsec;
+  enum wlr_log_importance level;
+  char text[LOG_RING_MESSAGE_SIZE];
+};
+
+static struct {
+  atomic_int level;
+  int64_t start_nsec;
+
+  struct log_entry *ring;
+  size_t size;
+  atomic_uint_fast64_t head;
+} log_state = {
+    .level = LOG_DEFAULT_LEVEL,
+};
+
+static char const *const level_names[] = {
+    [WLR_SILENT] = "silent",
+    [WLR_ERROR] = "error",
+    [WLR_INFO] = "info",
+    [WLR_DEBUG] = "debug",
+};
+
+static char const *const level_headers[] = {
+    [WLR_SILENT] = "",
+    [WLR_ERROR] = "[ERROR]",
+    [WLR_INFO] = "[INFO]",
+    [WLR_DEBUG] = "[DEBUG]",
+};
+
+/* Crash signals that flush the ring before the compositor dies */
+static int const crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+bool log_level_from_name(char const *name, enum wlr_log_importance *level) {
+  for (int i = 0; i < WLR_LOG_IMPORTANCE_LAST; i++) {
+    if (strcmp(name, level_names[i]) == 0) {
+      *level = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+char const *log_level_name(enum wlr_log_importance level) {
+  return level < WLR_LOG_IMPORTANCE_LAST ? level_names[level] : "unknown";
+}
+
+static void log_ring_store(enum wlr_log_importance importance,
+                           char const *fmt, va_list args) {
+  /*
+   * Writers only contend on the head index. If the ring wraps all the way
+   * around while an entry is being written the entry may be torn, which the
+   * sequence number lets the reader detect
+   */
+  uint64_t idx =
+      atomic_fetch_add_explicit(&log_state.head, 1, memory_order_relaxed);
+  struct log_entry *entry = &log_state.ring[idx % log_state.size];
+
+  atomic_store_explicit(&entry->seq, 0, memory_order_relaxed);
+  entry->nsec = get_time_nsec();
+  entry->level = importance;
+  vsnprintf(entry->text, sizeof(entry->text), fmt, args);
+  atomic_store_explicit(&entry->seq, idx + 1, memory_order_release);
+}
+
+static void log_stderr(enum wlr_log_importance importance, char const *fmt,
+                       va_list args) {
+  int64_t msec = (get_time_nsec() - log_state.start_nsec) / NSEC_PER_MSEC;
+
+  flockfile(stderr);
+  fprintf(stderr, "%02d:%02d:%02d.%03d %s ", (int)(msec / 3600000),
+          (int)(msec / 60000 % 60), (int)(msec / 1000 % 60),
+          (int)(msec % 1000), level_headers[importance]);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  funlockfile(stderr);
+}
+
+static void log_callback(enum wlr_log_importance importance, char const *fmt,
+                         va_list args) {
+  if (importance <= WLR_SILENT || importance >= WLR_LOG_IMPORTANCE_LAST) {
+    return;
+  }
+
+  if (log_state.ring) {
+    va_list copy;
+    va_copy(copy, args);
+    log_ring_store(importance, fmt, copy);
+    va_end(copy);
+  }
+
+  if ((int)importance <=
+      atomic_load_explicit(&log_state.level, memory_order_relaxed)) {
+    log_stderr(importance, fmt, args);
+  }
+}
+
+/* Formats value right aligned in width digits, zero padded */
+static char *format_uint(char *p, uint64_t value, int width) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value && n < (int)sizeof(digits));
+  while (n < width) {
+    digits[n++] = '0';
+  }
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+void log_ring_flush(int fd) {
+  if (!log_state.ring) {
+    return;
+  }
+
+  uint64_t head = atomic_load_explicit(&log_state.head, memory_order_acquire);
+  uint64_t start = head > log_state.size ? head - log_state.size : 0;
+
+  for (uint64_t idx = start; idx < head; idx++) {
+    struct log_entry *entry = &log_state.ring[idx % log_state.size];
+    char line[LOG_RING_MESSAGE_SIZE + 48];
+
+    if (atomic_load_explicit(&entry->seq, memory_order_acquire) != idx + 1) {
+      continue;
+    }
+
+    /* "[seconds.micros] [LEVEL] message" relative to startup */
+    int64_t usec = (entry->nsec - log_state.start_nsec) / NSEC_PER_USEC;
+    char *p = line;
+    *p++ = '[';
+    p = format_uint(p, usec / 1000000, 1);
+    *p++ = '.';
+    p = format_uint(p, usec % 1000000, 6);
+    *p++ = ']';
+    *p++ = ' ';
+    size_t len = strlen(level_headers[entry->level]);
+    memcpy(p, level_headers[entry->level], len);
+    p += len;
+    *p++ = ' ';
+    len = strnlen(entry->text, sizeof(entry->text) - 1);
+    memcpy(p, entry->text, len);
+    p += len;
+    *p++ = '\n';
+
+    /* Skip the entry if it was overwritten while being copied */
+    if (atomic_load_explicit(&entry->seq, memory_order_acquire) != idx + 1) {
+      continue;
+    }
+    ssize_t ret = write(fd, line, p - line);
+    (void)ret;
+  }
+}
+
+static void log_crash_handler(int sig) {
+  static char const msg[] = "wlmatchbox: fatal signal, recent log:\n";
+  ssize_t ret = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+  (void)ret;
+  log_ring_flush(STDERR_FILENO);
+
+  /* The default action was restored when the handler was entered */
+  raise(sig);
+}
+
+static void log_install_crash_handlers(void) {
+  /* Run on an alternate stack, so that stack overflows are caught too */
+  stack_t stack = {
+      .ss_size = SIGSTKSZ,
+  };
+  stack.ss_sp = malloc(stack.ss_size);
+  if (stack.ss_sp && sigaltstack(&stack, NULL) < 0) {
+    free(stack.ss_sp);
+  }
+
+  struct sigaction sa = {
+      .sa_handler = log_crash_handler,
+      .sa_flags = SA_RESETHAND | SA_NODEFER | SA_ONSTACK,
+  };
+  sigemptyset(&sa.sa_mask);
+  for (size_t i = 0; i < sizeof(crash_signals) / sizeof(*crash_signals);
+       i++) {
+    sigaction(crash_signals[i], &sa, NULL);
+  }
+}
+
+void log_init(enum wlr_log_importance level, size_t ring_entries) {
+  log_state.start_nsec = get_time_nsec();
+
+  if (ring_entries) {
+    log_state.ring = calloc(ring_entries, sizeof(*log_state.ring));
+    if (log_state.ring) {
+      log_state.size = ring_entries;
+      log_install_crash_handlers();
+    }
+  }
+
+  log_set_level(level);
+  if (ring_entries && !log_state.ring) {
+    wlr_log(WLR_ERROR, "Unable to allocate log ring of %zu entries",
+            ring_entries);
+  }
+}
+
+void log_set_level(enum wlr_log_importance level) {
+  atomic_store_explicit(&log_state.level, level, memory_order_relaxed);
+
+  /*
+   * wlroots checks its verbosity before doing some expensive debug work, so
+   * keep it in sync. The callback still sees every message, for the ring
+   */
+  wlr_log_init(level, log_callback);
+}
+
+enum wlr_log_importance log_get_level(void) {
+  return atomic_load_explicit(&log_state.level, memory_order_relaxed);
+}
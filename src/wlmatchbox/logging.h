@@ -0,0 +1,34 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _LOGGING_H
+#define _LOGGING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <wlr/util/log.h>
+
+#define LOG_DEFAULT_LEVEL (WLR_INFO)
+/* Size of a ring entry, including the terminator. Longer messages are cut */
+#define LOG_RING_MESSAGE_SIZE (240)
+
+/*
+ * Log sink for wlroots and the compositor. Messages up to the log level are
+ * written to stderr. If a ring is configured, every message (including debug
+ * messages above the log level) is also formatted into a fixed size in-memory
+ * ring without any I/O, and the ring is written to stderr when the compositor
+ * crashes or log_ring_flush() is called.
+ */
+void log_init(enum wlr_log_importance level, size_t ring_entries);
+void log_set_level(enum wlr_log_importance level);
+enum wlr_log_importance log_get_level(void);
+
+bool log_level_from_name(char const *name, enum wlr_log_importance *level);
+char const *log_level_name(enum wlr_log_importance level);
+
+/* Async-signal-safe */
+void log_ring_flush(int fd);
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "lowmem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+
+#include "cgroup.h"
+#include "client.h"
+#include "server.h"
+#include "toplevel.h"
+#include "trace.h"
+
+#define LOWMEM_PSI_PATH "/proc/pressure/memory"
+
+/*
+ * Added to the event count by the watcher thread when the trigger fails. The
+ * event fd is a sum, so this keeps the two apart
+ */
+#define LOWMEM_FAILED ((uint64_t)1 << 32)
+
+struct lowmem_candidate {
+  struct client *client;
+  /* When any of its toplevels last had the focus */
+  int64_t focus_nsec;
+  uint64_t rss;
+};
+
+static uint64_t lowmem_rss(pid_t pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+  FILE *f = fopen(path, "re");
+  if (!f) {
+    return 0;
+  }
+
+  unsigned long size, resident = 0;
+  if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(f);
+  return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+static int lowmem_candidate_cmp(void const *a, void const *b) {
+  struct lowmem_candidate const *ca = a;
+  struct lowmem_candidate const *cb = b;
+
+  if (ca->focus_nsec != cb->focus_nsec) {
+    return ca->focus_nsec < cb->focus_nsec ? -1 : 1;
+  }
+  if (ca->rss != cb->rss) {
+    return ca->rss > cb->rss ? -1 : 1;
+  }
+  return 0;
+}
+
+/*
+ * Collect the clients with toplevels that may be reclaimed, least recently
+ * focused first. Returns the number of candidates.
+ */
+static size_t lowmem_collect(struct server *server,
+                             struct lowmem_candidate *candidates) {
+  struct wlr_surface *focused = server->seat->keyboard_state.focused_surface;
+  struct wl_client *focused_client =
+      focused ? wl_resource_get_client(focused->resource) : NULL;
+  size_t count = 0;
+
+  struct toplevel *toplevel;
+  wl_list_for_each(toplevel, &server->toplevels, link) {
+    struct wl_client *wl_client =
+        wl_resource_get_client(toplevel->xdg_toplevel->resource);
+    if (wl_client == focused_client || wl_client == server->panel_client) {
+      continue;
+    }
+    struct client *client = client_from_wl_client(server, wl_client);
+    /* Clients on a preconnected socket report the compositor's pid */
+    if (!client || client->pid <= 0 || client->pid == getpid() ||
+        client->lowmem_unkillable) {
+      continue;
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+      if (candidates[i].client == client) {
+        break;
+      }
+    }
+    if (i == count) {
+      candidates[count++] = (struct lowmem_candidate){
+          .client = client,
+          .focus_nsec = toplevel->focus_nsec,
+          .rss = lowmem_rss(client->pid),
+      };
+    } else if (toplevel->focus_nsec > candidates[i].focus_nsec) {
+      candidates[i].focus_nsec = toplevel->focus_nsec;
+    }
+  }
+
+  qsort(candidates, count, sizeof(*candidates), lowmem_candidate_cmp);
+  return count;
+}
+
+static void lowmem_close(struct server *server,
+                         struct lowmem_candidate const *candidate) {
+  struct client *client = candidate->client;
+  wlr_log(WLR_INFO, "Memory pressure: closing %s (%d, %" PRIu64 " MiB)",
+          client->app_id ? client->app_id : "client", (int)client->pid,
+          candidate->rss >> 20);
+
+  struct toplevel *toplevel, *tmp;
+  wl_list_for_each_safe(toplevel, tmp, &server->toplevels, link) {
+    if (wl_resource_get_client(toplevel->xdg_toplevel->resource) ==
+        client->wl_client) {
+      toplevel_close(toplevel);
+    }
+  }
+  client->lowmem_close_nsec = get_time_nsec();
+  server->lowmem.closes++;
+  trace_instant("lowmem", "close", "pid", client->pid);
+}
+
+static void lowmem_kill(struct server *server,
+                        struct lowmem_candidate const *candidate) {
+  struct client *client = candidate->client;
+  wlr_log(WLR_INFO, "Memory pressure: killing %s (%d, %" PRIu64 " MiB)",
+          client->app_id ? client->app_id : "client", (int)client->pid,
+          candidate->rss >> 20);
+
+  /*
+   * Kill everything it started too if it has a cgroup of its own. A cgroup
+   * another client is still in would take that client with it, so then only
+   * its process is.
+   */
+  if (!client->cgroup || client_cgroup_shared(client) ||
+      !cgroup_write(client->cgroup, "cgroup.kill", "1")) {
+    if (kill(client->pid, SIGKILL) < 0) {
+      /*
+       * Waiting for it to go would retry the same kill forever, so leave it
+       * alone from now on and move on to the next one
+       */
+      wlr_log_errno(WLR_ERROR, "Unable to kill %d", (int)client->pid);
+      client->lowmem_close_nsec = 0;
+      client->lowmem_unkillable = true;
+      return;
+    }
+  }
+  server->lowmem.kills++;
+  trace_instant("lowmem", "kill", "pid", client->pid);
+}
+
+static void lowmem_reclaim(struct server *server) {
+  struct lowmem_candidate *candidates =
+      calloc(wl_list_length(&server->toplevels) + 1, sizeof(*candidates));
+  if (!candidates) {
+    return;
+  }
+  size_t count = lowmem_collect(server, candidates);
+  int64_t now = get_time_nsec();
+  bool closing = false;
+
+  /* Kill an application that ignored its close request */
+  for (size_t i = 0; i < count; i++) {
+    int64_t close_nsec = candidates[i].client->lowmem_close_nsec;
+    if (!close_nsec) {
+      continue;
+    }
+    if (now - close_nsec >= LOWMEM_KILL_DELAY_MSEC * NSEC_PER_MSEC) {
+      lowmem_kill(server, &candidates[i]);
+      goto out;
+    }
+    closing = true;
+  }
+
+  /* Otherwise, unless one is still closing, ask the next one to close */
+  if (closing) {
+    wlr_log(WLR_DEBUG, "Memory pressure: waiting for clients to close");
+  } else if (count) {
+    lowmem_close(server, &candidates[0]);
+  } else {
+    wlr_log(WLR_INFO, "Memory pressure: no background applications left");
+  }
+
+out:
+  free(candidates);
+}
+
+/*
+ * The trigger is signalled with POLLPRI, which the event loop doesn't wait
+ * for. Wrapping it in an epoll fd doesn't work either: the kernel clears the
+ * trigger whenever it is polled, and the main loop polls the event loop fd
+ * before dispatching it. So a thread waits for it and passes it on to the
+ * event loop through an event fd, as the keymap compiles do with their pipe.
+ */
+static void *lowmem_watch_thread(void *data) {
+  struct server *server = data;
+  struct pollfd fds[] = {
+      {.fd = server->lowmem.psi_fd, .events = POLLPRI},
+      {.fd = server->lowmem.stop_fd, .events = POLLIN},
+  };
+
+  for (;;) {
+    uint64_t value = 1;
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      value = LOWMEM_FAILED;
+    } else if (fds[1].revents) {
+      return NULL;
+    } else if (fds[0].revents & (POLLERR | POLLNVAL)) {
+      value = LOWMEM_FAILED;
+    } else if (!(fds[0].revents & POLLPRI)) {
+      continue;
+    }
+
+    ssize_t ret;
+    do {
+      ret = write(server->lowmem.event_fd, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+    if (value >= LOWMEM_FAILED) {
+      return NULL;
+    }
+  }
+}
+
+static int lowmem_pressure(int fd, uint32_t mask, void *data) {
+  struct server *server = check_sig_server(data);
+  watchdog_mark("lowmem.pressure");
+
+  uint64_t value;
+  if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+    return 0;
+  }
+  if (value >= LOWMEM_FAILED) {
+    wlr_log(WLR_ERROR, "Memory pressure monitoring failed");
+    lowmem_finish(server);
+    return 0;
+  }
+
+  /* Several triggers since the last dispatch only need one reclaim */
+  server->lowmem.events += value;
+  lowmem_reclaim(server);
+  return 0;
+}
+
+static void lowmem_close_fds(struct server *server) {
+  close(server->lowmem.stop_fd);
+  close(server->lowmem.event_fd);
+  close(server->lowmem.psi_fd);
+  server->lowmem.psi_fd = -1;
+}
+
+bool lowmem_init(struct server *server, int stall_msec) {
+  if (stall_msec > LOWMEM_WINDOW_MSEC) {
+    wlr_log(WLR_ERROR, "Memory stall threshold must be at most %d ms",
+            LOWMEM_WINDOW_MSEC);
+    return false;
+  }
+
+  int psi_fd = open(LOWMEM_PSI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (psi_fd < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to open " LOWMEM_PSI_PATH);
+    return false;
+  }
+
+  /* "some" counts the time any task is stalled, in microseconds */
+  char trigger[64];
+  snprintf(trigger, sizeof(trigger), "some %d %d", stall_msec * 1000,
+           LOWMEM_WINDOW_MSEC * 1000);
+  if (write(psi_fd, trigger, strlen(trigger) + 1) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to set memory pressure trigger '%s'",
+                  trigger);
+    close(psi_fd);
+    return false;
+  }
+
+  server->lowmem.psi_fd = psi_fd;
+  server->lowmem.event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  server->lowmem.stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (server->lowmem.event_fd < 0 || server->lowmem.stop_fd < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to create memory pressure event fd");
+    lowmem_close_fds(server);
+    return false;
+  }
+
+  server->lowmem.source = wl_event_loop_add_fd(
+      wl_display_get_event_loop(server->wl_display), server->lowmem.event_fd,
+      WL_EVENT_READABLE, lowmem_pressure, server);
+  if (!server->lowmem.source) {
+    lowmem_close_fds(server);
+    return false;
+  }
+
+  /*
+   * Signals are handled through a signalfd on the main thread, which only
+   * works if no other thread can receive them
+   */
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int ret = pthread_create(&server->lowmem.thread, NULL, lowmem_watch_thread,
+                           server);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (ret != 0) {
+    wlr_log(WLR_ERROR, "Unable to start memory pressure thread: %s",
+            strerror(ret));
+    wl_event_source_remove(server->lowmem.source);
+    lowmem_close_fds(server);
+    return false;
+  }
+
+  wlr_log(WLR_INFO, "Reclaiming applications when memory stalls exceed %d ms",
+          stall_msec);
+  return true;
+}
+
+void lowmem_finish(struct server *server) {
+  if (server->lowmem.psi_fd < 0) {
+    return;
+  }
+
+  uint64_t stop = 1;
+  if (write(server->lowmem.stop_fd, &stop, sizeof(stop)) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to stop memory pressure thread");
+  }
+  pthread_join(server->lowmem.thread, NULL);
+
+  wl_event_source_remove(server->lowmem.source);
+  lowmem_close_fds(server);
+}
+
+void lowmem_print(struct server *server, FILE *f) {
+  if (!server->lowmem.events) {
+    return;
+  }
+  fprintf(f,
+          "memory pressure: %" PRIu64 " events, %" PRIu64 " closed, %" PRIu64
+          " killed\n",
+          server->lowmem.events, server->lowmem.closes, server->lowmem.kills);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _LOWMEM_H
+#define _LOWMEM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct server;
+
+/*
+ * PSI window the stall threshold is measured over. Without CAP_SYS_RESOURCE
+ * the kernel only accepts multiples of 2 seconds
+ */
+#define LOWMEM_WINDOW_MSEC (2000)
+
+/* How long an application asked to close has before it is killed */
+#define LOWMEM_KILL_DELAY_MSEC (3000)
+
+/*
+ * Low memory manager. Whenever tasks have stalled on memory for stall_msec in
+ * a LOWMEM_WINDOW_MSEC window, the least recently focused application is
+ * asked to close, the largest first if several were never focused. If the
+ * pressure continues and it hasn't gone after LOWMEM_KILL_DELAY_MSEC it is
+ * killed. The focused application and the panel are never touched.
+ */
+bool lowmem_init(struct server *server, int stall_msec);
+void lowmem_finish(struct server *server);
+void lowmem_print(struct server *server, FILE *f);
+
+#endif
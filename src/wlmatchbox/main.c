@@ -4,16 +4,68 @@
  * SPDX-License-Identifier: MIT
  */
 #include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <wlr/backend.h>
 #include <wlr/util/log.h>
 
+#include "child.h"
+#include "ipc.h"
+#include "logging.h"
+#include "lowmem.h"
+#include "metrics.h"
+#include "priority.h"
 #include "server.h"
+#include "shm.h"
+#include "trace.h"
+#include "watchdog.h"
+
+enum {
+  OPT_XKB_RULES = 256,
+  OPT_XKB_MODEL,
+  OPT_XKB_LAYOUT,
+  OPT_XKB_VARIANT,
+  OPT_XKB_OPTIONS,
+  OPT_TRACE_EVENTS,
+  OPT_METRICS,
+  OPT_IPC,
+  OPT_STALL_THRESHOLD,
+  OPT_LOG_RING,
+  OPT_DEBUG_DAMAGE,
+  OPT_CPU_POLICY,
+  OPT_FREEZE_AFTER,
+  OPT_MEMORY_PRESSURE,
+  OPT_SHM_SOFT_LIMIT,
+  OPT_SHM_HARD_LIMIT,
+};
 
 static struct option options[] = {
     {"init", required_argument, NULL, 'i'},
     {"panel", required_argument, NULL, 'p'},
+    {"frame-stats", no_argument, NULL, 's'},
+    {"adaptive-render", no_argument, NULL, 'a'},
+    {"render-margin", required_argument, NULL, 'm'},
+    {"motion-coalesce", required_argument, NULL, 'c'},
+    {"xkb-rules", required_argument, NULL, OPT_XKB_RULES},
+    {"xkb-model", required_argument, NULL, OPT_XKB_MODEL},
+    {"xkb-layout", required_argument, NULL, OPT_XKB_LAYOUT},
+    {"xkb-variant", required_argument, NULL, OPT_XKB_VARIANT},
+    {"xkb-options", required_argument, NULL, OPT_XKB_OPTIONS},
+    {"trace", required_argument, NULL, 't'},
+    {"trace-events", required_argument, NULL, OPT_TRACE_EVENTS},
+    {"metrics", required_argument, NULL, OPT_METRICS},
+    {"ipc", required_argument, NULL, OPT_IPC},
+    {"stall-threshold", required_argument, NULL, OPT_STALL_THRESHOLD},
+    {"log-level", required_argument, NULL, 'l'},
+    {"log-ring", required_argument, NULL, OPT_LOG_RING},
+    {"debug-damage", no_argument, NULL, OPT_DEBUG_DAMAGE},
+    {"cpu-policy", required_argument, NULL, OPT_CPU_POLICY},
+    {"freeze-after", required_argument, NULL, OPT_FREEZE_AFTER},
+    {"memory-pressure", required_argument, NULL, OPT_MEMORY_PRESSURE},
+    {"shm-soft-limit", required_argument, NULL, OPT_SHM_SOFT_LIMIT},
+    {"shm-hard-limit", required_argument, NULL, OPT_SHM_HARD_LIMIT},
     {NULL},
 };
 
@@ -22,13 +74,47 @@ struct init_prog {
   char *prog;
 };
 
+static int handle_terminate(int signal, void *data) {
+  struct server *server = data;
+  server_terminate(server);
+  return 0;
+}
+
+static int handle_dump_trace(int signal, void *data) {
+  trace_dump();
+  return 0;
+}
+
+static int handle_dump_stats(int signal, void *data) {
+  struct server *server = data;
+  server_print_stats(server, stderr);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   char *panel_program = NULL;
+  bool frame_stats = false;
+  char const *trace_path = getenv("WLMATCHBOX_TRACE");
+  size_t trace_events = 0;
+  char const *metrics_path = NULL;
+  char const *ipc_path = NULL;
+  int stall_threshold_msec = WATCHDOG_DEFAULT_THRESHOLD_MSEC;
+  char const *log_level_name = getenv("WLMATCHBOX_LOG_LEVEL");
+  enum wlr_log_importance log_level = LOG_DEFAULT_LEVEL;
+  size_t log_ring = 0;
+  bool debug_damage = false;
+  int memory_pressure_msec = 0;
+  struct server_options server_options = {
+      .start_nsec = get_time_nsec(),
+      .render_margin_msec = 2,
+      .motion_coalesce = MOTION_COALESCE_FRAME,
+  };
   struct wl_list init_progs;
   wl_list_init(&init_progs);
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "i:p:", options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "i:p:sam:c:t:l:", options, NULL)) !=
+         -1) {
     switch (opt) {
     case 'i': {
       struct init_prog *p = calloc(1, sizeof(*p));
@@ -40,19 +126,207 @@ int main(int argc, char **argv) {
       panel_program = strdup(optarg);
       break;
 
+    case 's':
+      frame_stats = true;
+      break;
+
+    case 'a':
+      server_options.adaptive_render = true;
+      break;
+
+    case 'm':
+      server_options.render_margin_msec = atoi(optarg);
+      break;
+
+    case 'c':
+      if (strcmp(optarg, "none") == 0) {
+        server_options.motion_coalesce = MOTION_COALESCE_NONE;
+      } else if (strcmp(optarg, "frame") == 0) {
+        server_options.motion_coalesce = MOTION_COALESCE_FRAME;
+      } else if (strcmp(optarg, "output") == 0) {
+        server_options.motion_coalesce = MOTION_COALESCE_OUTPUT;
+      } else {
+        fprintf(stderr, "Unknown motion coalescing mode '%s'\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case OPT_XKB_RULES:
+      server_options.xkb.rules = optarg;
+      break;
+
+    case OPT_XKB_MODEL:
+      server_options.xkb.model = optarg;
+      break;
+
+    case OPT_XKB_LAYOUT:
+      server_options.xkb.layout = optarg;
+      break;
+
+    case OPT_XKB_VARIANT:
+      server_options.xkb.variant = optarg;
+      break;
+
+    case OPT_XKB_OPTIONS:
+      server_options.xkb.options = optarg;
+      break;
+
+    case 't':
+      trace_path = optarg;
+      break;
+
+    case OPT_TRACE_EVENTS:
+      trace_events = strtoul(optarg, NULL, 0);
+      break;
+
+    case OPT_METRICS:
+      metrics_path = optarg;
+      break;
+
+    case OPT_IPC:
+      ipc_path = optarg;
+      break;
+
+    case OPT_STALL_THRESHOLD:
+      stall_threshold_msec = atoi(optarg);
+      break;
+
+    case 'l':
+      log_level_name = optarg;
+      break;
+
+    case OPT_LOG_RING:
+      log_ring = strtoul(optarg, NULL, 0);
+      break;
+
+    case OPT_DEBUG_DAMAGE:
+      debug_damage = true;
+      break;
+
+    case OPT_CPU_POLICY:
+      if (!cpu_policy_from_name(optarg, &server_options.cpu_policy)) {
+        fprintf(stderr, "Unknown CPU policy '%s'\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case OPT_FREEZE_AFTER:
+      server_options.freeze_msec = atoi(optarg);
+      break;
+
+    case OPT_MEMORY_PRESSURE:
+      memory_pressure_msec = atoi(optarg);
+      break;
+
+    case OPT_SHM_SOFT_LIMIT:
+      server_options.shm_soft_limit = strtoull(optarg, NULL, 0) << 20;
+      break;
+
+    case OPT_SHM_HARD_LIMIT:
+      server_options.shm_hard_limit = strtoull(optarg, NULL, 0) << 20;
+      break;
+
     default:
-      printf("Usage: %s [-i|--init PROG] [-p|--panel PROG]\n", argv[0]);
+      printf("Usage: %s [OPTIONS]\n", argv[0]);
       printf("\n");
-      printf("  -i|--init PROG      Launch PROG on startup\n");
-      printf("  -p|--panel PROG     Launch PROG as application panel\n");
+      printf("  -i|--init CMD       Launch CMD on startup\n");
+      printf("  -p|--panel CMD      Launch CMD as application panel\n");
+      printf("  -s|--frame-stats    Print frame timing statistics on exit\n");
+      printf("  -a|--adaptive-render\n");
+      printf("                      Render as late as possible in a frame\n");
+      printf("  -m|--render-margin MS\n");
+      printf("                      Safety margin for adaptive rendering "
+             "(default 2)\n");
+      printf("  -c|--motion-coalesce none|frame|output\n");
+      printf("                      Hit test pointer motion once per input "
+             "frame or\n");
+      printf("                      output frame (default frame)\n");
+      printf("  --xkb-rules RULES\n");
+      printf("  --xkb-model MODEL\n");
+      printf("  --xkb-layout LAYOUT\n");
+      printf("  --xkb-variant VARIANT\n");
+      printf("  --xkb-options OPTIONS\n");
+      printf("                      Keyboard keymap names. Defaults to the "
+             "XKB_DEFAULT_*\n");
+      printf("                      environment variables\n");
+      printf("  -t|--trace FILE     Record a trace and write it to FILE on "
+             "SIGUSR2 and\n");
+      printf("                      exit (default $WLMATCHBOX_TRACE)\n");
+      printf("  --trace-events N    Number of trace events to keep "
+             "(default 65536)\n");
+      printf("  --metrics PATH      Serve Prometheus metrics on the Unix "
+             "socket PATH\n");
+      printf("                      (default "
+             "$XDG_RUNTIME_DIR/$WAYLAND_DISPLAY.metrics,\n");
+      printf("                      empty to disable)\n");
+      printf("  --ipc PATH          Listen for control commands on the Unix "
+             "socket PATH\n");
+      printf("                      (default "
+             "$XDG_RUNTIME_DIR/$WAYLAND_DISPLAY.ipc,\n");
+      printf("                      empty to disable)\n");
+      printf("  --stall-threshold MS\n");
+      printf("                      Report event loop handlers that run "
+             "longer than MS\n");
+      printf("                      (default %d, 0 to disable)\n",
+             WATCHDOG_DEFAULT_THRESHOLD_MSEC);
+      printf("  -l|--log-level silent|error|info|debug\n");
+      printf("                      Messages to write to stderr (default "
+             "info, or\n");
+      printf("                      $WLMATCHBOX_LOG_LEVEL)\n");
+      printf("  --log-ring N        Keep the last N messages of any level in "
+             "memory and\n");
+      printf("                      write them out on a crash (default 0)\n");
+      printf("  --debug-damage      Highlight the damaged regions of each "
+             "frame\n");
+      printf("  --cpu-policy none|nice|cgroup\n");
+      printf("                      Lower the CPU priority of clients "
+             "without the\n");
+      printf("                      keyboard focus (default none)\n");
+      printf("  --freeze-after MS   Freeze started programs whose windows "
+             "have all been\n");
+      printf("                      hidden for MS (default 0, never)\n");
+      printf("  --memory-pressure MS\n");
+      printf("                      Close and then kill background "
+             "applications when\n");
+      printf("                      memory stalls exceed MS in 2 seconds "
+             "(default 0,\n");
+      printf("                      never)\n");
+      printf("  --shm-soft-limit MIB\n");
+      printf("                      Log clients sharing more than MIB of "
+             "memory through\n");
+      printf("                      wl_shm (default 0, no limit)\n");
+      printf("  --shm-hard-limit MIB\n");
+      printf("                      Disconnect clients that try to share "
+             "more than MIB\n");
+      printf("                      (default 0, no limit)\n");
       exit(EXIT_FAILURE);
       break;
     }
   }
 
-  wlr_log_init(WLR_DEBUG, NULL);
+  if (log_level_name && *log_level_name &&
+      !log_level_from_name(log_level_name, &log_level)) {
+    fprintf(stderr, "Unknown log level '%s'\n", log_level_name);
+    exit(EXIT_FAILURE);
+  }
+  log_init(log_level, log_ring);
+  watchdog_init(stall_threshold_msec * NSEC_PER_MSEC);
 
-  struct server *server = server_create();
+  if (trace_path && *trace_path && !trace_init(trace_events, trace_path)) {
+    return 1;
+  }
+
+  /*
+   * wlroots reads this when the scene is created. It is removed again so
+   * that it isn't passed on to clients, which may also use wlroots
+   */
+  if (debug_damage) {
+    setenv("WLR_SCENE_DEBUG_DAMAGE", "highlight", true);
+  }
+  struct server *server = server_create(&server_options);
+  if (debug_damage) {
+    unsetenv("WLR_SCENE_DEBUG_DAMAGE");
+  }
 
   if (!server) {
     return 1;
@@ -66,18 +340,42 @@ int main(int argc, char **argv) {
   }
   setenv("WAYLAND_DISPLAY", socket, true);
   printf("Display is %s\n", socket);
+  fflush(stdout);
+
+  char default_metrics_path[4096];
+  if (!metrics_path && getenv("XDG_RUNTIME_DIR")) {
+    snprintf(default_metrics_path, sizeof(default_metrics_path),
+             "%s/%s.metrics", getenv("XDG_RUNTIME_DIR"), socket);
+    metrics_path = default_metrics_path;
+  }
+  if (metrics_path && *metrics_path) {
+    metrics_init(server, metrics_path);
+  }
+
+  char default_ipc_path[4096];
+  if (!ipc_path && getenv("XDG_RUNTIME_DIR")) {
+    snprintf(default_ipc_path, sizeof(default_ipc_path), "%s/%s.ipc",
+             getenv("XDG_RUNTIME_DIR"), socket);
+    ipc_path = default_ipc_path;
+  }
+  if (ipc_path && *ipc_path) {
+    ipc_init(server, ipc_path);
+  }
+  if (memory_pressure_msec > 0) {
+    lowmem_init(server, memory_pressure_msec);
+  }
+  startup_phase(server, "socket");
 
   if (!wlr_backend_start(server->wlr_backend)) {
     wlr_log(WLR_ERROR, "Failed to start backend\n");
     return 1;
   }
+  server->stats.start_nsec = get_time_nsec();
+  startup_phase(server, "backend-start");
 
   struct init_prog *p, *next_p;
   wl_list_for_each_safe(p, next_p, &init_progs, link) {
-    if (fork() == 0) {
-      execlp(p->prog, p->prog, NULL);
-      _exit(EXIT_FAILURE);
-    }
+    child_launch(server, p->prog, NULL);
     wl_list_remove(&p->link);
     free(p->prog);
     free(p);
@@ -87,8 +385,33 @@ int main(int argc, char **argv) {
     server_create_panel(server, panel_program);
     free(panel_program);
   }
+  startup_phase(server, "clients");
+
+  struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+  struct wl_event_source *sigterm_source =
+      wl_event_loop_add_signal(loop, SIGTERM, handle_terminate, server);
+  struct wl_event_source *sigint_source =
+      wl_event_loop_add_signal(loop, SIGINT, handle_terminate, server);
+  struct wl_event_source *sigusr1_source =
+      wl_event_loop_add_signal(loop, SIGUSR1, handle_dump_stats, server);
+  struct wl_event_source *sigusr2_source =
+      wl_event_loop_add_signal(loop, SIGUSR2, handle_dump_trace, server);
+
+  server_run(server);
+
+  if (frame_stats) {
+    server_print_stats(server, stdout);
+  }
 
-  wl_display_run(server->wl_display);
+  wl_event_source_remove(sigterm_source);
+  wl_event_source_remove(sigint_source);
+  wl_event_source_remove(sigusr1_source);
+  wl_event_source_remove(sigusr2_source);
+  metrics_finish(server);
+  ipc_finish(server);
+  lowmem_finish(server);
+  shm_finish(server);
+  trace_dump();
   wl_display_destroy(server->wl_display);
   free(server);
   return 0;
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#define _GNU_SOURCE
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+
+#include "client.h"
+#include "output.h"
+#include "server.h"
+#include "unix_socket.h"
+
+/* Connections still being written to. Any more are closed immediately */
+#define METRICS_MAX_CONNECTIONS (8)
+
+struct metrics_connection {
+  struct wl_list link;
+  struct server *server;
+  int fd;
+  struct wl_event_source *source;
+  char *buf;
+  size_t len;
+  size_t offset;
+
+  struct metrics_connection_sig const *sig;
+};
+DECLARE_TYPE(metrics_connection)
+DEFINE_TYPE(metrics_connection)
+
+/* Upper bounds of the render time histogram buckets, in seconds */
+static double const render_buckets[] = {
+    0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.050, 0.100,
+};
+
+static void write_label_value(FILE *f, char const *value) {
+  for (; *value; value++) {
+    switch (*value) {
+    case '\\':
+      fputs("\\\\", f);
+      break;
+    case '"':
+      fputs("\\\"", f);
+      break;
+    case '\n':
+      fputs("\\n", f);
+      break;
+    default:
+      fputc(*value, f);
+      break;
+    }
+  }
+}
+
+static void write_header(FILE *f, char const *name, char const *type,
+                         char const *help) {
+  fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_output_value(FILE *f, char const *name,
+                               struct output *output, uint64_t value) {
+  fprintf(f, "%s{output=\"", name);
+  write_label_value(f, output->wlr_output->name);
+  fprintf(f, "\"} %" PRIu64 "\n", value);
+}
+
+void metrics_write(struct server *server, FILE *f) {
+  struct output *output;
+  char const *name = "wlmatchbox_frames_rendered_total";
+  write_header(f, name, "counter", "Frames rendered and committed");
+  wl_list_for_each(output, &server->outputs, link) {
+    write_output_value(f, name, output, output->stats.frames);
+  }
+
+  name = "wlmatchbox_frames_skipped_total";
+  write_header(f, name, "counter", "Frame events with nothing to render");
+  wl_list_for_each(output, &server->outputs, link) {
+    write_output_value(f, name, output, output->stats.skipped);
+  }
+
+  name = "wlmatchbox_frames_missed_total";
+  write_header(f, name, "counter", "Vblanks missed by a late commit");
+  wl_list_for_each(output, &server->outputs, link) {
+    write_output_value(f, name, output, output->stats.missed);
+  }
+
+  name = "wlmatchbox_damaged_pixels_total";
+  write_header(f, name, "counter", "Output pixels redrawn by rendered frames");
+  wl_list_for_each(output, &server->outputs, link) {
+    write_output_value(f, name, output, output->stats.damage_pixels);
+  }
+
+  name = "wlmatchbox_full_redraws_total";
+  write_header(f, name, "counter",
+               "Rendered frames that redrew the whole output");
+  wl_list_for_each(output, &server->outputs, link) {
+    write_output_value(f, name, output, output->stats.full_redraws);
+  }
+
+  name = "wlmatchbox_render_seconds";
+  write_header(f, name, "histogram", "Time to render and commit a frame");
+  wl_list_for_each(output, &server->outputs, link) {
+    struct histogram const *h = &output->stats.render_time;
+    for (size_t i = 0; i < sizeof(render_buckets) / sizeof(*render_buckets);
+         i++) {
+      fprintf(f, "%s_bucket{output=\"", name);
+      write_label_value(f, output->wlr_output->name);
+      fprintf(f, "\",le=\"%g\"} %" PRIu64 "\n", render_buckets[i],
+              histogram_count_le(h, render_buckets[i] * NSEC_PER_SEC));
+    }
+    fprintf(f, "%s_bucket{output=\"", name);
+    write_label_value(f, output->wlr_output->name);
+    fprintf(f, "\",le=\"+Inf\"} %" PRIu64 "\n", h->count);
+    fprintf(f, "%s_sum{output=\"", name);
+    write_label_value(f, output->wlr_output->name);
+    fprintf(f, "\"} %.9f\n", (double)h->sum / NSEC_PER_SEC);
+    fprintf(f, "%s_count{output=\"", name);
+    write_label_value(f, output->wlr_output->name);
+    fprintf(f, "\"} %" PRIu64 "\n", h->count);
+  }
+
+  write_header(f, "wlmatchbox_clients", "gauge", "Connected Wayland clients");
+  fprintf(f, "wlmatchbox_clients %d\n", wl_list_length(&server->clients));
+
+  write_header(f, "wlmatchbox_toplevels", "gauge", "Mapped toplevels");
+  fprintf(f, "wlmatchbox_toplevels %d\n", wl_list_length(&server->toplevels));
+
+  write_header(f, "wlmatchbox_popups", "gauge", "Popups");
+  fprintf(f, "wlmatchbox_popups %d\n", server->popups);
+
+  name = "wlmatchbox_input_events_total";
+  write_header(f, name, "counter", "Input events by type");
+  fprintf(f, "%s{type=\"key\"} %" PRIu64 "\n", name, server->stats.key_events);
+  fprintf(f, "%s{type=\"pointer_motion\"} %" PRIu64 "\n", name,
+          server->stats.motion_events);
+  fprintf(f, "%s{type=\"pointer_button\"} %" PRIu64 "\n", name,
+          server->stats.button_events);
+  fprintf(f, "%s{type=\"pointer_axis\"} %" PRIu64 "\n", name,
+          server->stats.axis_events);
+
+  name = "wlmatchbox_memory_pressure_events_total";
+  write_header(f, name, "counter", "Memory pressure trigger events");
+  fprintf(f, "%s %" PRIu64 "\n", name, server->lowmem.events);
+
+  name = "wlmatchbox_memory_pressure_reclaims_total";
+  write_header(f, name, "counter",
+               "Applications closed or killed because of memory pressure");
+  fprintf(f, "%s{action=\"close\"} %" PRIu64 "\n", name,
+          server->lowmem.closes);
+  fprintf(f, "%s{action=\"kill\"} %" PRIu64 "\n", name,
+          server->lowmem.kills);
+
+  name = "wlmatchbox_client_commits_total";
+  write_header(f, name, "counter", "Surface commits by client");
+  struct client *client;
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f, "%s{pid=\"%d\",app_id=\"", name, client->pid);
+    write_label_value(f, client->app_id ? client->app_id : "");
+    fprintf(f, "\"} %" PRIu64 "\n", client->commits);
+  }
+
+  name = "wlmatchbox_client_shm_pool_bytes";
+  write_header(f, name, "gauge", "Bytes of mapped wl_shm pools by client");
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f, "%s{pid=\"%d\",app_id=\"", name, client->pid);
+    write_label_value(f, client->app_id ? client->app_id : "");
+    fprintf(f, "\"} %" PRIu64 "\n", client->shm.pool_bytes);
+  }
+
+  name = "wlmatchbox_client_shm_buffer_bytes";
+  write_header(f, name, "gauge", "Bytes of live wl_shm buffers by client");
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f, "%s{pid=\"%d\",app_id=\"", name, client->pid);
+    write_label_value(f, client->app_id ? client->app_id : "");
+    fprintf(f, "\"} %" PRIu64 "\n", client->shm.buffer_bytes);
+  }
+
+  name = "wlmatchbox_client_surfaces";
+  write_header(f, name, "gauge", "Surfaces by client");
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f, "%s{pid=\"%d\",app_id=\"", name, client->pid);
+    write_label_value(f, client->app_id ? client->app_id : "");
+    fprintf(f, "\"} %d\n", client->shm.surfaces);
+  }
+
+  name = "wlmatchbox_client_full_damage_commits_total";
+  write_header(f, name, "counter",
+               "Surface commits damaging the whole surface by client");
+  wl_list_for_each(client, &server->clients, link) {
+    fprintf(f, "%s{pid=\"%d\",app_id=\"", name, client->pid);
+    write_label_value(f, client->app_id ? client->app_id : "");
+    fprintf(f, "\"} %" PRIu64 "\n", client->full_damage_commits);
+  }
+}
+
+static void metrics_connection_destroy(struct metrics_connection *conn) {
+  if (conn->source) {
+    wl_event_source_remove(conn->source);
+  }
+  close(conn->fd);
+  wl_list_remove(&conn->link);
+  conn->server->metrics.num_connections--;
+  free(conn->buf);
+  free(conn);
+}
+
+/* Returns true once everything has been written or the connection failed */
+static bool metrics_connection_flush(struct metrics_connection *conn) {
+  while (conn->offset < conn->len) {
+    ssize_t ret = send(conn->fd, conn->buf + conn->offset,
+                       conn->len - conn->offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno != EAGAIN && errno != EWOULDBLOCK;
+    }
+    conn->offset += ret;
+  }
+  return true;
+}
+
+static int metrics_connection_writable(int fd, uint32_t mask, void *data) {
+  struct metrics_connection *conn = check_sig_metrics_connection(data);
+  watchdog_mark("metrics.connection");
+  if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) ||
+      metrics_connection_flush(conn)) {
+    metrics_connection_destroy(conn);
+  }
+  return 0;
+}
+
+static int metrics_accept(int fd, uint32_t mask, void *data) {
+  struct server *server = check_sig_server(data);
+  watchdog_mark("metrics.accept");
+
+  int conn_fd;
+  while ((conn_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >=
+         0) {
+    if (server->metrics.num_connections >= METRICS_MAX_CONNECTIONS) {
+      close(conn_fd);
+      continue;
+    }
+
+    struct metrics_connection *conn = alloc_metrics_connection();
+    conn->server = server;
+    conn->fd = conn_fd;
+    wl_list_insert(&server->metrics.connections, &conn->link);
+    server->metrics.num_connections++;
+
+    FILE *f = open_memstream(&conn->buf, &conn->len);
+    if (!f) {
+      metrics_connection_destroy(conn);
+      continue;
+    }
+    metrics_write(server, f);
+    fclose(f);
+
+    /*
+     * Almost always the whole response fits in the socket buffer. If it
+     * doesn't, the rest is written as the reader drains it
+     */
+    if (metrics_connection_flush(conn)) {
+      metrics_connection_destroy(conn);
+      continue;
+    }
+    conn->source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(server->wl_display), conn_fd,
+        WL_EVENT_WRITABLE, metrics_connection_writable, conn);
+    if (!conn->source) {
+      metrics_connection_destroy(conn);
+    }
+  }
+  return 0;
+}
+
+bool metrics_init(struct server *server, char const *path) {
+  wl_list_init(&server->metrics.connections);
+  server->metrics.fd = -1;
+
+  int fd = unix_socket_listen(path, METRICS_MAX_CONNECTIONS);
+  if (fd < 0) {
+    return false;
+  }
+
+  server->metrics.source =
+      wl_event_loop_add_fd(wl_display_get_event_loop(server->wl_display), fd,
+                           WL_EVENT_READABLE, metrics_accept, server);
+  if (!server->metrics.source) {
+    close(fd);
+    unlink(path);
+    return false;
+  }
+  server->metrics.fd = fd;
+  server->metrics.path = strdup(path);
+
+  wlr_log(WLR_INFO, "Serving metrics on %s", path);
+  return true;
+}
+
+void metrics_finish(struct server *server) {
+  if (server->metrics.fd < 0) {
+    return;
+  }
+
+  struct metrics_connection *conn, *tmp;
+  wl_list_for_each_safe(conn, tmp, &server->metrics.connections, link) {
+    metrics_connection_destroy(conn);
+  }
+  wl_event_source_remove(server->metrics.source);
+  close(server->metrics.fd);
+  unlink(server->metrics.path);
+  free(server->metrics.path);
+  server->metrics.fd = -1;
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct server;
+
+/*
+ * Read-only metrics socket. Every connection is sent the current metrics in
+ * the Prometheus text exposition format and then closed.
+ */
+bool metrics_init(struct server *server, char const *path);
+void metrics_finish(struct server *server);
+void metrics_write(struct server *server, FILE *f);
+
+#endif
@@ -5,46 +5,286 @@
  */
 #include "output.h"
 
+#include <inttypes.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 
+#include "client.h"
+#include "hud.h"
+#include "probes.h"
 #include "server.h"
 #include "toplevel.h"
+#include "trace.h"
 
 DEFINE_TYPE(output)
 
-static void output_frame_notify(struct wl_listener *listener, void *data) {
-  struct output *output = get_type_ptr(output, listener, output, frame);
-  struct wlr_scene *scene = output->server->scene;
+/*
+ * Number of frames to render immediately after a delayed render missed its
+ * vblank, before trying to delay again
+ */
+#define RENDER_BACKOFF_FRAMES (60)
 
+/* Number of renders to observe before the render time estimate is trusted */
+#define RENDER_LEARN_FRAMES (8)
+
+static int64_t refresh_period_nsec(struct output *output) {
+  if (output->wlr_output->refresh <= 0) {
+    return 0;
+  }
+  return NSEC_PER_SEC * 1000 / output->wlr_output->refresh;
+}
+
+static uint64_t region_area(pixman_region32_t const *region) {
+  int n;
+  pixman_box32_t const *boxes = pixman_region32_rectangles(region, &n);
+  uint64_t area = 0;
+  for (int i = 0; i < n; i++) {
+    area += (uint64_t)(boxes[i].x2 - boxes[i].x1) * (boxes[i].y2 - boxes[i].y1);
+  }
+  return area;
+}
+
+static void output_render(struct output *output) {
   struct wlr_scene_output *scene_output =
-      wlr_scene_get_scene_output(scene, output->wlr_output);
+      wlr_scene_get_scene_output(output->server->scene, output->wlr_output);
 
   /* Render the scene if needed and commit the output */
-  wlr_scene_output_commit(scene_output, NULL);
+  if (!wlr_scene_output_needs_frame(scene_output)) {
+    output->stats.skipped++;
+    return;
+  }
+
+  /* The damage is consumed by the commit, so it has to be measured first */
+  uint64_t damage_pixels = region_area(&scene_output->pending_commit_damage);
+
+  int64_t start_nsec = get_time_nsec();
+  if (!wlr_scene_output_commit(scene_output, NULL)) {
+    return;
+  }
+  int64_t render_nsec = get_time_nsec() - start_nsec;
+  PROBE2(render, output->wlr_output->name, render_nsec);
+  if (trace_enabled) {
+    trace_record(TRACE_SPAN, "output", "render", start_nsec, render_nsec,
+                 "frame", output->stats.frames + 1);
+  }
+
+  output->stats.frames++;
+  output->stats.damage_pixels += damage_pixels;
+  if (damage_pixels >= (uint64_t)output->wlr_output->width *
+                           output->wlr_output->height) {
+    output->stats.full_redraws++;
+  }
+  if (!output->server->startup.reported) {
+    startup_output_commit(output->server);
+  }
+  output->stats.last_commit_nsec = output->sched.frame_nsec;
+  output->stats.present_commit_nsec = start_nsec + render_nsec;
+  histogram_add(&output->stats.render_time, render_nsec);
+
+  /*
+   * Track the mean and mean deviation of the render time with exponential
+   * moving averages, so the prediction follows changes in the scene
+   */
+  int64_t error = render_nsec - output->sched.predicted_nsec;
+  output->sched.predicted_nsec += error / 8;
+  output->sched.deviation_nsec +=
+      ((error < 0 ? -error : error) - output->sched.deviation_nsec) / 4;
+}
+
+static int output_render_delay_msec(struct output *output) {
+  struct server_options const *options = &output->server->options;
+  int64_t period = refresh_period_nsec(output);
+
+  if (!output->render_timer || !period ||
+      output->stats.frames < RENDER_LEARN_FRAMES) {
+    return 0;
+  }
+
+  if (output->sched.backoff) {
+    output->sched.backoff--;
+    return 0;
+  }
+
+  int64_t budget = output->sched.predicted_nsec +
+                   4 * output->sched.deviation_nsec +
+                   options->render_margin_msec * NSEC_PER_MSEC;
+  if (budget >= period) {
+    return 0;
+  }
+  return (period - budget) / NSEC_PER_MSEC;
+}
+
+static int output_render_timer(void *data) {
+  struct output *output = check_sig_output(data);
+  watchdog_mark("output.render_timer");
+  output->sched.render_pending = false;
+  output_render(output);
+  return 0;
+}
+
+static void output_frame_notify(struct wl_listener *listener, void *data) {
+  struct output *output = get_type_ptr(output, listener, output, frame);
+
+  server_flush_cursor_motion(output->server);
+
+  if (output->sched.render_pending) {
+    /* A delayed render is already scheduled for this frame */
+    return;
+  }
+
+  struct wlr_scene_output *scene_output =
+      wlr_scene_get_scene_output(output->server->scene, output->wlr_output);
 
   struct timespec now;
   clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t frame_nsec = timespec_to_nsec(&now);
+  PROBE2(frame, output->wlr_output->name, frame_nsec);
+
+  /*
+   * A commit is followed by a frame event on the next vblank, so if it took
+   * more than one and a half refresh periods to get here the commit missed at
+   * least one vblank.
+   */
+  int64_t period = refresh_period_nsec(output);
+  if (output->stats.last_commit_nsec && period) {
+    int64_t interval = frame_nsec - output->stats.last_commit_nsec;
+    if (interval > period + period / 2) {
+      output->stats.missed += (interval + period / 2) / period - 1;
+      if (output->sched.delayed) {
+        output->sched.backoff = RENDER_BACKOFF_FRAMES;
+      }
+    }
+  }
+  output->stats.last_commit_nsec = 0;
+  output->sched.frame_nsec = frame_nsec;
+
+  /*
+   * With adaptive rendering, composition is pushed as close to the next
+   * vblank as the predicted render time allows, so client commits that
+   * arrive in the meantime still make it into this frame
+   */
+  int delay_msec = output_render_delay_msec(output);
+  trace_instant("output", "frame", "delay_msec", delay_msec);
+  output->sched.delayed = delay_msec > 0;
+  if (output->sched.delayed) {
+    output->sched.render_pending = true;
+    wl_event_source_timer_update(output->render_timer, delay_msec);
+  } else {
+    output_render(output);
+  }
+
   wlr_scene_output_send_frame_done(scene_output, &now);
 }
 
+static void output_present_notify(struct wl_listener *listener, void *data) {
+  struct output *output = get_type_ptr(output, listener, output, present);
+  struct wlr_output_event_present const *event = data;
+
+  /*
+   * Only one commit can be waiting for presentation at a time, so this event
+   * belongs to the last commit made by output_render()
+   */
+  int64_t commit_nsec = output->stats.present_commit_nsec;
+  output->stats.present_commit_nsec = 0;
+
+  if (!event->presented) {
+    output->stats.discarded++;
+    trace_instant("output", "discarded", "commit_seq", event->commit_seq);
+    return;
+  }
+  trace_instant("output", "present", "commit_seq", event->commit_seq);
+
+  int64_t present_nsec = timespec_to_nsec(&event->when);
+  if (commit_nsec && present_nsec >= commit_nsec) {
+    histogram_add(&output->stats.present_latency, present_nsec - commit_nsec);
+    if (output->server->clients_pending_present) {
+      client_output_present(output, commit_nsec, present_nsec);
+    }
+  }
+  if (output->stats.last_present_nsec &&
+      present_nsec > output->stats.last_present_nsec) {
+    histogram_add(&output->stats.present_interval,
+                  present_nsec - output->stats.last_present_nsec);
+  }
+  output->stats.last_present_nsec = present_nsec;
+}
+
+static void output_fullscreen_sample_notify(struct wl_listener *listener,
+                                            void *data) {
+  struct output *output =
+      get_type_ptr(output, listener, output, fullscreen_sample);
+  struct wlr_scene_output_sample_event const *event = data;
+
+  if (event->output->output != output->wlr_output) {
+    return;
+  }
+
+  if (event->direct_scanout) {
+    output->stats.scanout++;
+  } else {
+    output->stats.scanout_fallback++;
+  }
+}
+
+static void output_unwatch_scanout(struct output *output) {
+  if (output->fullscreen_buffer) {
+    wl_list_remove(&output->fullscreen_sample.link);
+    wl_list_remove(&output->fullscreen_buffer_destroy.link);
+    output->fullscreen_buffer = NULL;
+  }
+}
+
+static void
+output_fullscreen_buffer_destroy_notify(struct wl_listener *listener,
+                                        void *data) {
+  struct output *output =
+      get_type_ptr(output, listener, output, fullscreen_buffer_destroy);
+  output_unwatch_scanout(output);
+}
+
+struct find_surface_buffer {
+  struct wlr_surface *surface;
+  struct wlr_scene_buffer *buffer;
+};
+
+static void find_surface_buffer_iter(struct wlr_scene_buffer *buffer, int sx,
+                                     int sy, void *data) {
+  struct find_surface_buffer *find = data;
+  struct wlr_scene_surface *scene_surface =
+      wlr_scene_surface_try_from_buffer(buffer);
+  if (scene_surface && scene_surface->surface == find->surface) {
+    find->buffer = buffer;
+  }
+}
+
 static void output_request_state_notify(struct wl_listener *listener,
                                         void *data) {
   struct output *output = get_type_ptr(output, listener, output, request_state);
   const struct wlr_output_event_request_state *event = data;
   wlr_output_commit_state(output->wlr_output, event->state);
+
+  /* Toplevels on an output that is turned off are suspended */
+  if (event->state->committed & WLR_OUTPUT_STATE_ENABLED) {
+    output_update_visibility(output);
+  }
 }
 
 static void output_destroy_notify(struct wl_listener *listener, void *data) {
   struct output *output = get_type_ptr(output, listener, output, destroy);
   struct server *server = output->server;
 
+  if (output->render_timer) {
+    wl_event_source_remove(output->render_timer);
+  }
+  output_unwatch_scanout(output);
+  hud_remove_output(output);
+  client_output_destroy(output);
   wl_list_remove(&output->frame.link);
+  wl_list_remove(&output->present.link);
   wl_list_remove(&output->request_state.link);
   wl_list_remove(&output->destroy.link);
   wl_list_remove(&output->link);
-  free(output);
 
   // Unassign any toplevels on this output to another
   struct toplevel *toplevel;
@@ -53,6 +293,87 @@ static void output_destroy_notify(struct wl_listener *listener, void *data) {
       toplevel_assign_any_output(toplevel);
     }
   }
+
+  free(output);
+}
+
+void output_update_visibility(struct output *output) {
+  /*
+   * Walk the toplevels on this output from top to bottom. Everything below
+   * the first window that covers the output can't be seen, so it is removed
+   * from the scene, which also stops its frame callbacks.
+   */
+  struct toplevel *top = NULL;
+  bool covered = false;
+  struct toplevel *toplevel;
+  wl_list_for_each(toplevel, &output->server->toplevels, link) {
+    if (toplevel->output != output || toplevel == output->panel) {
+      continue;
+    }
+    toplevel_set_occluded(toplevel, covered);
+    if (toplevel->minimized) {
+      toplevel->covers_output = false;
+      continue;
+    }
+    if (!top) {
+      top = toplevel;
+    }
+    toplevel->covers_output = toplevel_covers_output(toplevel);
+    if (toplevel->covers_output) {
+      covered = true;
+    }
+  }
+
+  /* The panel is hidden while the topmost window on the output is fullscreen */
+  struct toplevel *fullscreen = top && top->fullscreen ? top : NULL;
+  if (output->panel) {
+    wlr_scene_node_set_enabled(&output->panel->scene_tree->node, !fullscreen);
+  }
+
+  if (fullscreen == output->fullscreen) {
+    return;
+  }
+
+  output_unwatch_scanout(output);
+  output->fullscreen = fullscreen;
+  if (fullscreen) {
+    struct find_surface_buffer find = {
+        .surface = fullscreen->xdg_toplevel->base->surface,
+    };
+    wlr_scene_node_for_each_buffer(&fullscreen->scene_tree->node,
+                                   find_surface_buffer_iter, &find);
+    if (find.buffer) {
+      output->fullscreen_buffer = find.buffer;
+      bind_clbk(&output->fullscreen_sample, &find.buffer->events.output_sample,
+                output_fullscreen_sample_notify);
+      bind_clbk(&output->fullscreen_buffer_destroy,
+                &find.buffer->node.events.destroy,
+                output_fullscreen_buffer_destroy_notify);
+    }
+  }
+}
+
+void output_print_stats(struct output *output, FILE *f) {
+  fprintf(f, "%s:\n", output->wlr_output->name);
+  fprintf(f,
+          "  frames: %" PRIu64 " rendered, %" PRIu64 " skipped, %" PRIu64
+          " missed, %" PRIu64 " discarded\n",
+          output->stats.frames, output->stats.skipped, output->stats.missed,
+          output->stats.discarded);
+  fprintf(f, "  scanout: %" PRIu64 " direct, %" PRIu64 " fallback\n",
+          output->stats.scanout, output->stats.scanout_fallback);
+  uint64_t output_pixels = (uint64_t)output->wlr_output->width *
+                           output->wlr_output->height * output->stats.frames;
+  fprintf(f, "  damage: %.1f%% of the output per frame, %" PRIu64
+          " full redraws\n",
+          output_pixels ? output->stats.damage_pixels * 100.0 / output_pixels
+                        : 0,
+          output->stats.full_redraws);
+  histogram_print_msec(&output->stats.render_time, f, "render time");
+  histogram_print_msec(&output->stats.present_latency, f,
+                       "commit to present");
+  histogram_print_msec(&output->stats.present_interval, f,
+                       "present interval");
 }
 
 void output_create(struct server *server, struct wlr_output *wlr_output) {
@@ -63,11 +384,19 @@ void output_create(struct server *server, struct wlr_output *wlr_output) {
 
   bind_clbk(&o->frame, &wlr_output->events.frame, output_frame_notify);
 
+  bind_clbk(&o->present, &wlr_output->events.present, output_present_notify);
+
   bind_clbk(&o->request_state, &wlr_output->events.request_state,
             output_request_state_notify);
 
   bind_clbk(&o->destroy, &wlr_output->events.destroy, output_destroy_notify);
 
+  if (server->options.adaptive_render) {
+    o->render_timer =
+        wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display),
+                                output_render_timer, o);
+  }
+
   // Initialize output
   wlr_output_init_render(wlr_output, server->wlr_allocator,
                          server->wlr_renderer);
@@ -100,5 +429,7 @@ void output_create(struct server *server, struct wlr_output *wlr_output) {
       toplevel_assign_output(toplevel, o);
     }
   }
+
+  hud_add_output(o);
 }
 
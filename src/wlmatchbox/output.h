@@ -6,8 +6,10 @@
 #ifndef _OUTPUT_H
 #define _OUTPUT_H
 
+#include <stdio.h>
 #include <wayland-server.h>
 
+#include "stats.h"
 #include "util.h"
 
 struct output {
@@ -16,14 +18,51 @@ struct output {
   struct server *server;
 
   struct wl_listener frame;
+  struct wl_listener present;
   struct wl_listener request_state;
   struct wl_listener destroy;
 
   struct toplevel *panel;
 
+  struct toplevel *fullscreen;
+  struct wlr_scene_buffer *fullscreen_buffer;
+  struct wl_listener fullscreen_sample;
+  struct wl_listener fullscreen_buffer_destroy;
+
+  struct hud *hud;
+
+  struct wl_event_source *render_timer;
+  struct {
+    int64_t frame_nsec;
+    int64_t predicted_nsec;
+    int64_t deviation_nsec;
+    unsigned int backoff;
+    bool delayed;
+    bool render_pending;
+  } sched;
+
+  struct {
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t missed;
+    uint64_t scanout;
+    uint64_t scanout_fallback;
+    uint64_t discarded;
+    uint64_t damage_pixels;
+    uint64_t full_redraws;
+    int64_t last_commit_nsec;
+    int64_t present_commit_nsec;
+    int64_t last_present_nsec;
+    struct histogram render_time;
+    struct histogram present_latency;
+    struct histogram present_interval;
+  } stats;
+
   struct output_sig const *sig;
 };
 DECLARE_TYPE(output)
 
 void output_create(struct server *server, struct wlr_output *wlr_output);
+void output_update_visibility(struct output *output);
+void output_print_stats(struct output *output, FILE *f);
 #endif
@@ -8,12 +8,20 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
 
+#include "client.h"
+#include "probes.h"
+#include "server.h"
+
 DEFINE_TYPE(popup)
 
 static void xdg_popup_commit(struct wl_listener *listener, void *data) {
   /* Called when a new surface state is committed. */
   struct popup *popup = get_type_ptr(popup, listener, popup, commit);
 
+  popup->server->stats.commits++;
+  client_surface_commit(popup->server, popup->xdg_popup->base->surface);
+  PROBE2(commit, "", popup->xdg_popup->base->surface);
+
   if (popup->xdg_popup->base->initial_commit) {
     wlr_xdg_surface_schedule_configure(popup->xdg_popup->base);
   }
@@ -25,6 +33,7 @@ static void xdg_popup_destroy(struct wl_listener *listener, void *data) {
 
   wl_list_remove(&popup->commit.link);
   wl_list_remove(&popup->destroy.link);
+  popup->server->popups--;
 
   free(popup);
 }
@@ -49,4 +58,5 @@ void popup_create(struct server *server, struct wlr_xdg_popup *xdg_popup) {
             xdg_popup_commit);
 
   bind_clbk(&popup->destroy, &xdg_popup->events.destroy, xdg_popup_destroy);
+  server->popups++;
 }
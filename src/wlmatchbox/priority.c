@@ -0,0 +1,252 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "priority.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/capability.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+#include "cgroup.h"
+
+/* How deep to follow the children of a client's process */
+#define PRIORITY_MAX_DEPTH (4)
+
+static char const *const policy_names[] = {
+    [CPU_POLICY_NONE] = "none",
+    [CPU_POLICY_NICE] = "nice",
+    [CPU_POLICY_CGROUP] = "cgroup",
+};
+
+static char const *const class_names[] = {
+    [CPU_CLASS_DEFAULT] = "default",
+    [CPU_CLASS_FOREGROUND] = "foreground",
+    [CPU_CLASS_BACKGROUND] = "background",
+};
+
+bool cpu_policy_from_name(char const *name, enum cpu_policy *policy) {
+  for (size_t i = 0; i < sizeof(policy_names) / sizeof(*policy_names); i++) {
+    if (strcmp(name, policy_names[i]) == 0) {
+      *policy = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+char const *cpu_policy_name(enum cpu_policy policy) {
+  return policy_names[policy];
+}
+
+char const *cpu_class_name(enum cpu_class cpu_class) {
+  return class_names[cpu_class];
+}
+
+/*
+ * A nice value only applies to a single thread, so every thread of the
+ * process is changed, as well as those of the processes it started (e.g. the
+ * content processes of a browser).
+ */
+static void priority_renice(struct server *server, pid_t pid, int nice,
+                            int depth) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    pid_t tid = atoi(ent->d_name);
+
+    if (setpriority(PRIO_PROCESS, tid, nice) < 0 &&
+        (errno == EACCES || errno == EPERM) && !server->cpu.denied) {
+      /* Only lowering the nice value needs a privilege */
+      wlr_log(WLR_ERROR,
+              "Unable to restore the priority of %d, this needs "
+              "CAP_SYS_NICE or RLIMIT_NICE",
+              (int)tid);
+      server->cpu.denied = true;
+    }
+
+    if (depth >= PRIORITY_MAX_DEPTH) {
+      continue;
+    }
+    char children_path[128];
+    snprintf(children_path, sizeof(children_path), "%s/%d/children", path,
+             (int)tid);
+    FILE *f = fopen(children_path, "re");
+    if (!f) {
+      continue;
+    }
+    int child;
+    while (fscanf(f, "%d", &child) == 1) {
+      priority_renice(server, child, nice, depth + 1);
+    }
+    fclose(f);
+  }
+  closedir(dir);
+}
+
+static void priority_set_weight(struct server *server, struct client *client,
+                                int weight) {
+  if (!client->cgroup) {
+    char name[32];
+    snprintf(name, sizeof(name), "client-%d", (int)client->pid);
+    client->cgroup = cgroup_create_leaf(server, name, client->pid);
+    if (!client->cgroup) {
+      return;
+    }
+  }
+
+  char value[16];
+  snprintf(value, sizeof(value), "%d", weight);
+  if (!cgroup_write(client->cgroup, "cpu.weight", value)) {
+    wlr_log_errno(WLR_ERROR, "Unable to set the CPU weight of %s",
+                  client->cgroup);
+  }
+}
+
+static void priority_set(struct server *server, struct client *client,
+                         enum cpu_class cpu_class) {
+  client->cpu_class = cpu_class;
+
+  /* Clients on a preconnected socket report the compositor's own pid */
+  if (client->pid <= 0 || client->pid == getpid()) {
+    return;
+  }
+
+  bool foreground = cpu_class == CPU_CLASS_FOREGROUND;
+  switch (server->options.cpu_policy) {
+  case CPU_POLICY_NONE:
+    break;
+
+  case CPU_POLICY_NICE:
+    priority_renice(server, client->pid,
+                    foreground ? 0 : PRIORITY_BACKGROUND_NICE, 0);
+    break;
+
+  case CPU_POLICY_CGROUP:
+    priority_set_weight(server, client,
+                        foreground ? PRIORITY_FOREGROUND_WEIGHT
+                                   : PRIORITY_BACKGROUND_WEIGHT);
+    break;
+  }
+}
+
+/*
+ * Whether nice values can be lowered again, which needs a RLIMIT_NICE of 20
+ * (allowing a nice value of 0) or CAP_SYS_NICE
+ */
+static bool priority_can_renice(void) {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NICE, &limit) == 0 &&
+      (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= 20)) {
+    return true;
+  }
+
+  FILE *f = fopen("/proc/self/status", "re");
+  if (!f) {
+    return false;
+  }
+  char *line = NULL;
+  size_t size = 0;
+  uint64_t caps = 0;
+  while (getline(&line, &size, f) > 0) {
+    if (sscanf(line, "CapEff: %" SCNx64, &caps) == 1) {
+      break;
+    }
+  }
+  free(line);
+  fclose(f);
+  return caps & (UINT64_C(1) << CAP_SYS_NICE);
+}
+
+void priority_init(struct server *server) {
+  switch (server->options.cpu_policy) {
+  case CPU_POLICY_NONE:
+    break;
+
+  case CPU_POLICY_NICE:
+    if (!priority_can_renice()) {
+      wlr_log(WLR_ERROR, "Unable to use the nice CPU policy, restoring the "
+                         "priority of a client needs CAP_SYS_NICE or a "
+                         "RLIMIT_NICE of at least 20");
+      server->options.cpu_policy = CPU_POLICY_NONE;
+    }
+    break;
+
+  case CPU_POLICY_CGROUP: {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", PRIORITY_COMPOSITOR_WEIGHT);
+    if (!cgroup_init(server, "+cpu") ||
+        !cgroup_write(server->cgroup.compositor, "cpu.weight", value)) {
+      wlr_log(WLR_ERROR, "Unable to use the cgroup CPU policy");
+      server->options.cpu_policy = CPU_POLICY_NONE;
+    }
+    break;
+  }
+  }
+}
+
+void priority_focus(struct server *server, struct client *client) {
+  struct client *prev = server->cpu.foreground;
+  if (server->options.cpu_policy == CPU_POLICY_NONE || client == prev) {
+    return;
+  }
+
+  server->cpu.foreground = client;
+  if (prev) {
+    priority_set(server, prev, CPU_CLASS_BACKGROUND);
+  }
+  /* Last, in case both clients are the same process */
+  if (client) {
+    priority_set(server, client, CPU_CLASS_FOREGROUND);
+  }
+}
+
+void priority_client_destroy(struct client *client) {
+  struct server *server = client->server;
+  if (server->cpu.foreground == client) {
+    server->cpu.foreground = NULL;
+  }
+
+  /* The process usually exits with its connection, which empties the leaf */
+  if (client->cgroup && !cgroup_remove(client->cgroup)) {
+    wlr_log_errno(WLR_DEBUG, "Unable to remove %s", client->cgroup);
+  }
+  free(client->cgroup);
+}
+
+void priority_print(struct server *server, FILE *f) {
+  if (server->options.cpu_policy == CPU_POLICY_NONE) {
+    return;
+  }
+
+  int background = 0;
+  struct client *client;
+  wl_list_for_each(client, &server->clients, link) {
+    background += client->cpu_class == CPU_CLASS_BACKGROUND;
+  }
+
+  struct client *foreground = server->cpu.foreground;
+  fprintf(f, "cpu policy %s: ", cpu_policy_name(server->options.cpu_policy));
+  if (foreground) {
+    fprintf(f, "foreground %d (%s), ", (int)foreground->pid,
+            foreground->app_id ? foreground->app_id : "no toplevel");
+  }
+  fprintf(f, "%d background clients\n", background);
+}
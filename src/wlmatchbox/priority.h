@@ -0,0 +1,41 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _PRIORITY_H
+#define _PRIORITY_H
+
+#include <stdio.h>
+
+#include "client.h"
+#include "server.h"
+
+/* Nice value of the processes of background clients with CPU_POLICY_NICE */
+#define PRIORITY_BACKGROUND_NICE (10)
+
+/* cpu.weight of the cgroups with CPU_POLICY_CGROUP. The default is 100 */
+#define PRIORITY_COMPOSITOR_WEIGHT (1000)
+#define PRIORITY_FOREGROUND_WEIGHT (1000)
+#define PRIORITY_BACKGROUND_WEIGHT (25)
+
+bool cpu_policy_from_name(char const *name, enum cpu_policy *policy);
+char const *cpu_policy_name(enum cpu_policy policy);
+char const *cpu_class_name(enum cpu_class cpu_class);
+
+/*
+ * Set up the CPU policy in the server options. If it can't be applied the
+ * compositor falls back to CPU_POLICY_NONE.
+ */
+void priority_init(struct server *server);
+
+/*
+ * Give the client that owns the newly focused toplevel the foreground
+ * priority, and the client that had it the background priority. Clients that
+ * have never had a focused toplevel, such as the panel, keep their priority.
+ */
+void priority_focus(struct server *server, struct client *client);
+void priority_client_destroy(struct client *client);
+void priority_print(struct server *server, FILE *f);
+
+#endif
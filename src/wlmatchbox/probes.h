@@ -0,0 +1,33 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _PROBES_H
+#define _PROBES_H
+
+#include "config.h"
+
+/*
+ * USDT (statically defined tracing) probes, provider "wlmatchbox". When built
+ * with -Dusdt=true each probe is a nop instruction plus an ELF note, which
+ * bpftrace, perf and systemtap can attach to at runtime. Otherwise they
+ * compile to nothing and their arguments are not evaluated.
+ */
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(wlmatchbox, name)
+#define PROBE1(name, a) DTRACE_PROBE1(wlmatchbox, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(wlmatchbox, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(wlmatchbox, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(wlmatchbox, name, a, b, c, d)
+#else
+#define PROBE(name) ((void)0)
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#define PROBE4(name, a, b, c, d) ((void)0)
+#endif
+
+#endif
@@ -7,6 +7,9 @@
 
 #include "server.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <wlr/backend.h>
@@ -14,6 +17,9 @@
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_presentation_time.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_xcursor_manager.h>
@@ -23,13 +29,32 @@
 #include <wlr/xwayland.h>
 #endif
 
+#include "child.h"
+#include "client.h"
+#include "freezer.h"
+#include "hud.h"
 #include "keyboard.h"
+#include "keymap.h"
+#include "launch.h"
+#include "lowmem.h"
 #include "output.h"
 #include "popup.h"
+#include "priority.h"
+#include "probes.h"
+#include "shm.h"
 #include "toplevel.h"
+#include "trace.h"
+#include "watchdog.h"
 
 DEFINE_TYPE(server)
 
+/* Delay before restarting a panel that exited, doubled on every restart */
+#define PANEL_RESTART_MIN_MSEC (1000)
+#define PANEL_RESTART_MAX_MSEC (30000)
+
+/* A panel that ran for this long resets the restart delay */
+#define PANEL_HEALTHY_NSEC (30 * NSEC_PER_SEC)
+
 static void new_output_notify(struct wl_listener *listener, void *data) {
   struct server *server = get_type_ptr(server, listener, server, new_output);
   struct wlr_output *wlr_output = data;
@@ -94,6 +119,8 @@ static void server_new_input(struct wl_listener *listener, void *data) {
 
 // Cursor Handling
 static void process_cursor_motion(struct server *server, uint32_t time) {
+  int64_t trace_start = trace_begin();
+  PROBE3(pointer_motion, time, (int)server->cursor->x, (int)server->cursor->y);
   double sx, sy;
   struct wlr_seat *seat = server->seat;
   struct wlr_surface *surface = NULL;
@@ -121,6 +148,45 @@ static void process_cursor_motion(struct server *server, uint32_t time) {
      * the last client to have the cursor over it. */
     wlr_seat_pointer_clear_focus(seat);
   }
+  trace_end("input", "pointer-motion", trace_start, "time_msec", time);
+}
+
+/*
+ * Queue up pointer motion so that only the last position is hit tested and
+ * sent to clients, either at the end of the input frame or at the next output
+ * frame.
+ */
+static void queue_cursor_motion(struct server *server, uint32_t time) {
+  server->stats.motion_events++;
+
+  if (server->options.motion_coalesce == MOTION_COALESCE_NONE) {
+    process_cursor_motion(server, time);
+    return;
+  }
+
+  if (server->cursor_motion_pending) {
+    server->stats.motion_coalesced++;
+  } else if (server->options.motion_coalesce == MOTION_COALESCE_OUTPUT) {
+    struct output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+      wlr_output_schedule_frame(output->wlr_output);
+    }
+  }
+  server->cursor_motion_pending = true;
+  server->cursor_motion_time = time;
+}
+
+void server_flush_cursor_motion(struct server *server) {
+  if (!server->cursor_motion_pending) {
+    return;
+  }
+  server->cursor_motion_pending = false;
+  process_cursor_motion(server, server->cursor_motion_time);
+
+  if (server->options.motion_coalesce == MOTION_COALESCE_OUTPUT) {
+    /* The pointer frame for this motion was held back when it was queued */
+    wlr_seat_pointer_notify_frame(server->seat);
+  }
 }
 
 static void server_cursor_motion(struct wl_listener *listener, void *data) {
@@ -128,7 +194,14 @@ static void server_cursor_motion(struct wl_listener *listener, void *data) {
   struct wlr_pointer_motion_event *event = data;
   wlr_cursor_move(server->cursor, &event->pointer->base, event->delta_x,
                   event->delta_y);
-  process_cursor_motion(server, event->time_msec);
+
+  /* Relative motion is never coalesced, so no deltas are lost */
+  wlr_relative_pointer_manager_v1_send_relative_motion(
+      server->relative_pointer_manager, server->seat,
+      (uint64_t)event->time_msec * 1000, event->delta_x, event->delta_y,
+      event->unaccel_dx, event->unaccel_dy);
+
+  queue_cursor_motion(server, event->time_msec);
 }
 
 static void server_cursor_motion_absolute(struct wl_listener *listener,
@@ -138,12 +211,19 @@ static void server_cursor_motion_absolute(struct wl_listener *listener,
   struct wlr_pointer_motion_absolute_event *event = data;
   wlr_cursor_warp_absolute(server->cursor, &event->pointer->base, event->x,
                            event->y);
-  process_cursor_motion(server, event->time_msec);
+  queue_cursor_motion(server, event->time_msec);
 }
 
 static void server_cursor_button(struct wl_listener *listener, void *data) {
   struct server *server = get_type_ptr(server, listener, server, cursor_button);
   struct wlr_pointer_button_event *event = data;
+
+  int64_t trace_start = trace_begin();
+  server->stats.button_events++;
+
+  /* Make sure the button goes to the surface under the current position */
+  server_flush_cursor_motion(server);
+
   /* Notify the client with pointer focus that a button press has occurred */
   wlr_seat_pointer_notify_button(server->seat, event->time_msec, event->button,
                                  event->state);
@@ -155,11 +235,14 @@ static void server_cursor_button(struct wl_listener *listener, void *data) {
         server, server->cursor->x, server->cursor->y, &surface, &sx, &sy);
     toplevel_focus(toplevel);
   }
+  trace_end("input", "pointer-button", trace_start, "button", event->button);
 }
 
 static void server_cursor_axis(struct wl_listener *listener, void *data) {
   struct server *server = get_type_ptr(server, listener, server, cursor_axis);
   struct wlr_pointer_axis_event *event = data;
+  server->stats.axis_events++;
+  server_flush_cursor_motion(server);
   wlr_seat_pointer_notify_axis(
       server->seat, event->time_msec, event->orientation, event->delta,
       event->delta_discrete, event->source, event->relative_direction);
@@ -167,6 +250,12 @@ static void server_cursor_axis(struct wl_listener *listener, void *data) {
 
 static void server_cursor_frame(struct wl_listener *listener, void *data) {
   struct server *server = get_type_ptr(server, listener, server, cursor_frame);
+  if (server->options.motion_coalesce == MOTION_COALESCE_OUTPUT &&
+      server->cursor_motion_pending) {
+    /* Sent along with the motion on the next output frame */
+    return;
+  }
+  server_flush_cursor_motion(server);
   wlr_seat_pointer_notify_frame(server->seat);
 }
 
@@ -193,47 +282,110 @@ static void server_new_xdg_popup(struct wl_listener *listener, void *data) {
 }
 
 static struct wl_client *exec_client(struct server *server,
-                                     char const *program) {
+                                     char const *program,
+                                     struct child **child) {
   int socks[2];
-  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, socks)) {
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks)) {
     fprintf(stderr, "Unable to create socket pair: %s\n", strerror(errno));
     return NULL;
   }
-  int ret = fork();
-  if (ret == 0) {
-    char sock_buf[512];
+
+  struct launch_options options = {
+      .wayland_socket = socks[0],
+  };
+  int64_t start_nsec = get_time_nsec();
+  pid_t pid = launch_command(program, &options);
+  close(socks[0]);
+  if (pid < 0) {
     close(socks[1]);
-    snprintf(sock_buf, sizeof(sock_buf), "%d", socks[0]);
-    setenv("WAYLAND_SOCKET", sock_buf, 1);
-    execlp(program, program, NULL);
-    _exit(EXIT_FAILURE);
-  } else if (ret > 0) {
-    close(socks[0]);
-
-    struct wl_client *client = wl_client_create(server->wl_display, socks[1]);
-    if (!client) {
-      close(socks[1]);
-    }
-    return client;
+    return NULL;
+  }
 
-  } else {
-    fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
-    close(socks[0]);
+  *child = child_create(server, pid, program);
+  if (*child) {
+    (*child)->start_nsec = start_nsec;
+  }
+
+  struct wl_client *client = wl_client_create(server->wl_display, socks[1]);
+  if (!client) {
     close(socks[1]);
     return NULL;
   }
+
+  client_set_spawned(client_from_wl_client(server, client), pid, start_nsec);
+  return client;
 }
 
 static void on_panel_client_destroy(struct wl_listener *listener, void *data) {
   struct server *server =
       get_type_ptr(server, listener, server, panel_client_destroy);
 
-  wlr_log(WLR_DEBUG, "Panel client exited");
+  /* The process is tracked separately, it may still be running */
+  wlr_log(WLR_DEBUG, "Panel client disconnected");
 
   wl_list_remove(&server->panel_client_destroy.link);
   server->panel_client = NULL;
 }
 
+static void server_start_panel(struct server *server);
+
+static void panel_schedule_restart(struct server *server) {
+  wlr_log(WLR_ERROR, "Restarting panel in %d ms", server->panel_restart_msec);
+  wl_event_source_timer_update(server->panel_restart_timer,
+                               server->panel_restart_msec);
+  server->panel_restart_msec *= 2;
+  if (server->panel_restart_msec > PANEL_RESTART_MAX_MSEC) {
+    server->panel_restart_msec = PANEL_RESTART_MAX_MSEC;
+  }
+}
+
+static void on_panel_exit(struct wl_listener *listener, void *data) {
+  struct server *server = get_type_ptr(server, listener, server, panel_exit);
+  struct child *child = data;
+
+  wl_list_remove(&server->panel_exit.link);
+  server->panel_child = NULL;
+
+  /* Only back off if the panel keeps dying shortly after it starts */
+  if (child->runtime_nsec >= PANEL_HEALTHY_NSEC) {
+    server->panel_restart_msec = PANEL_RESTART_MIN_MSEC;
+  }
+  panel_schedule_restart(server);
+}
+
+static int panel_restart_timer(void *data) {
+  struct server *server = check_sig_server(data);
+  watchdog_mark("server.panel_restart_timer");
+  server_start_panel(server);
+  return 0;
+}
+
+static void server_start_panel(struct server *server) {
+  if (server->panel_child) {
+    return;
+  }
+
+  if (server->panel_client) {
+    /* Left over connection from a previous instance */
+    wl_client_destroy(server->panel_client);
+  }
+
+  struct child *child = NULL;
+  server->panel_client = exec_client(server, server->panel_command, &child);
+  if (server->panel_client) {
+    server->panel_client_destroy.notify = on_panel_client_destroy;
+    wl_client_add_destroy_listener(server->panel_client,
+                                   &server->panel_client_destroy);
+  }
+
+  if (child) {
+    server->panel_child = child;
+    bind_clbk(&server->panel_exit, &child->events.exit, on_panel_exit);
+  } else if (!server->panel_client) {
+    panel_schedule_restart(server);
+  }
+}
+
 static bool global_filter(struct wl_client const *client,
                           struct wl_global const *global, void *data) {
   struct server *server = data;
@@ -258,6 +410,11 @@ bool server_handle_keybinding(struct server *server, xkb_keysym_t sym) {
     toplevel_focus(next_toplevel);
     break;
 
+  case XKB_KEY_F12:
+    /* Show or hide the performance HUD */
+    hud_toggle(server);
+    break;
+
   default:
     return false;
   }
@@ -265,26 +422,93 @@ bool server_handle_keybinding(struct server *server, xkb_keysym_t sym) {
 }
 
 void server_create_panel(struct server *server, char const *program) {
-  if (server->panel_client) {
+  if (server->panel_command) {
     return;
   }
 
-  server->panel_client = exec_client(server, program);
-  if (server->panel_client) {
-    server->panel_client_destroy.notify = on_panel_client_destroy;
-    wl_client_add_destroy_listener(server->panel_client,
-                                   &server->panel_client_destroy);
+  server->panel_command = strdup(program);
+  server->panel_restart_msec = PANEL_RESTART_MIN_MSEC;
+  server->panel_restart_timer =
+      wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display),
+                              panel_restart_timer, server);
+  server_start_panel(server);
+}
+
+void server_print_stats(struct server *server, FILE *f) {
+  startup_print(server, f);
+  client_print_stats(server, f);
+  priority_print(server, f);
+  lowmem_print(server, f);
+
+  struct output *output;
+  wl_list_for_each_reverse(output, &server->outputs, link) {
+    output_print_stats(output, f);
   }
+
+  double elapsed =
+      (get_time_nsec() - server->stats.start_nsec) / (double)NSEC_PER_SEC;
+  fprintf(f, "commits: %" PRIu64 " (%.1f/s)\n", server->stats.commits,
+          elapsed > 0 ? server->stats.commits / elapsed : 0);
+  fprintf(f, "pointer motion: %" PRIu64 " events, %" PRIu64 " coalesced\n",
+          server->stats.motion_events, server->stats.motion_coalesced);
+  watchdog_print(f);
 }
 
-struct server *server_create(void) {
+void server_run(struct server *server) {
+  struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+  struct pollfd pfd = {
+      .fd = wl_event_loop_get_fd(loop),
+      .events = POLLIN,
+  };
+
+  /*
+   * The same as wl_display_run(), except that the wait for events is done
+   * separately so that the watchdog only times the dispatch itself
+   */
+  server->running = true;
+  while (server->running) {
+    watchdog_begin("event-loop.idle");
+    wl_event_loop_dispatch_idle(loop);
+    watchdog_end();
+    wl_display_flush_clients(server->wl_display);
+
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+      wlr_log_errno(WLR_ERROR, "Unable to wait for events");
+      break;
+    }
+
+    watchdog_begin("event-loop");
+    wl_event_loop_dispatch(loop, 0);
+    watchdog_end();
+  }
+}
+
+void server_terminate(struct server *server) { server->running = false; }
+
+struct server *server_create(struct server_options const *options) {
   struct server *server = alloc_server();
+  server->options = *options;
   wl_list_init(&server->outputs);
   wl_list_init(&server->keyboards);
   wl_list_init(&server->toplevels);
+  wl_list_init(&server->children);
+  server->startup.start_nsec = options->start_nsec;
+  server->metrics.fd = -1;
+  server->ipc.fd = -1;
+  server->lowmem.psi_fd = -1;
 
   server->wl_display = wl_display_create();
   wl_display_set_global_filter(server->wl_display, global_filter, server);
+  client_init(server);
+  shm_init(server);
+  priority_init(server);
+  freezer_init(server);
+  startup_phase(server, "display");
+
+  if (!keymap_init(server)) {
+    return NULL;
+  }
+  startup_phase(server, "keymap");
 
   server->wlr_backend = wlr_backend_autocreate(
       wl_display_get_event_loop(server->wl_display), NULL);
@@ -292,6 +516,7 @@ struct server *server_create(void) {
     wlr_log(WLR_ERROR, "failed to create wlr_backend");
     return NULL;
   }
+  startup_phase(server, "backend");
 
   server->wlr_renderer = wlr_renderer_autocreate(server->wlr_backend);
   if (server->wlr_renderer == NULL) {
@@ -300,6 +525,7 @@ struct server *server_create(void) {
   }
 
   wlr_renderer_init_wl_display(server->wlr_renderer, server->wl_display);
+  startup_phase(server, "renderer");
 
   server->wlr_allocator =
       wlr_allocator_autocreate(server->wlr_backend, server->wlr_renderer);
@@ -307,16 +533,22 @@ struct server *server_create(void) {
     wlr_log(WLR_ERROR, "failed to create wlr_allocator");
     return NULL;
   }
+  startup_phase(server, "allocator");
 
   wlr_compositor_create(server->wl_display, 5, server->wlr_renderer);
   wlr_subcompositor_create(server->wl_display);
   wlr_data_device_manager_create(server->wl_display);
+  wlr_presentation_create(server->wl_display, server->wlr_backend, 2);
+  startup_phase(server, "compositor");
 
   // Layout
   server->output_layout = wlr_output_layout_create(server->wl_display);
   server->scene = wlr_scene_create();
   server->scene_layout =
       wlr_scene_attach_output_layout(server->scene, server->output_layout);
+  /* Windows, with overlays such as the HUD always drawn above them */
+  server->layers.toplevels = wlr_scene_tree_create(&server->scene->tree);
+  server->layers.overlay = wlr_scene_tree_create(&server->scene->tree);
 
   // Outputs
   bind_clbk(&server->new_output, &server->wlr_backend->events.new_output,
@@ -334,6 +566,7 @@ struct server *server_create(void) {
   bind_clbk(&server->request_set_selection,
             &server->seat->events.request_set_selection,
             seat_request_set_selection);
+  startup_phase(server, "seat");
 
   // Cursor
   server->cursor = wlr_cursor_create();
@@ -356,6 +589,10 @@ struct server *server_create(void) {
   bind_clbk(&server->cursor_frame, &server->cursor->events.frame,
             server_cursor_frame);
 
+  server->relative_pointer_manager =
+      wlr_relative_pointer_manager_v1_create(server->wl_display);
+  startup_phase(server, "cursor");
+
   // Keyboard
   server->new_input.notify = server_new_input;
   wl_signal_add(&server->wlr_backend->events.new_input, &server->new_input);
@@ -366,10 +603,11 @@ struct server *server_create(void) {
       wlr_xwayland_create(server->wl_display, server->wlr_compositor, true);
   bind_clbk(&server->new_xwayland_surface,
             &server->xwayland->events.new_surface, new_xwayland_surface_notify);
+  startup_phase(server, "xwayland");
 #endif
 
   // XDG shell
-  server->xdg_shell = wlr_xdg_shell_create(server->wl_display, 3);
+  server->xdg_shell = wlr_xdg_shell_create(server->wl_display, 6);
   bind_clbk(&server->new_xdg_toplevel, &server->xdg_shell->events.new_toplevel,
             server_new_xdg_toplevel);
   bind_clbk(&server->new_xdg_popup, &server->xdg_shell->events.new_popup,
@@ -378,6 +616,7 @@ struct server *server_create(void) {
   // Foreign toplevel
   server->foreign_toplevel_manager =
       wlr_foreign_toplevel_manager_v1_create(server->wl_display);
+  startup_phase(server, "xdg-shell");
 
   return server;
 }
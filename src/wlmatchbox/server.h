@@ -6,12 +6,46 @@
 #ifndef _SERVER_H
 #define _SERVER_H
 
+#include <pthread.h>
+#include <stdio.h>
 #include <wayland-server.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "startup.h"
 #include "util.h"
 
+enum motion_coalesce {
+  MOTION_COALESCE_NONE,
+  MOTION_COALESCE_FRAME,
+  MOTION_COALESCE_OUTPUT,
+};
+
+/* How the CPU priority of clients follows the keyboard focus */
+enum cpu_policy {
+  CPU_POLICY_NONE,
+  CPU_POLICY_NICE,
+  CPU_POLICY_CGROUP,
+};
+
+struct server_options {
+  /* Time main() was entered, the origin of the startup timing */
+  int64_t start_nsec;
+  bool adaptive_render;
+  int render_margin_msec;
+  enum motion_coalesce motion_coalesce;
+  enum cpu_policy cpu_policy;
+  /* Freeze clients that have been hidden this long, 0 to never freeze */
+  int freeze_msec;
+  /* Bytes of wl_shm pools per client, 0 for no limit */
+  uint64_t shm_soft_limit;
+  uint64_t shm_hard_limit;
+  struct xkb_rule_names xkb;
+};
+
 struct server {
+  struct server_options options;
+  bool running;
+
   struct wl_display *wl_display;
   struct wlr_backend *wlr_backend;
   struct wlr_renderer *wlr_renderer;
@@ -24,6 +58,10 @@ struct server {
   struct wlr_output_layout *output_layout;
   struct wlr_scene *scene;
   struct wlr_scene_output_layout *scene_layout;
+  struct {
+    struct wlr_scene_tree *toplevels;
+    struct wlr_scene_tree *overlay;
+  } layers;
 
   struct wlr_seat *seat;
   struct wl_listener request_cursor;
@@ -37,9 +75,15 @@ struct server {
   struct wl_listener cursor_button;
   struct wl_listener cursor_axis;
   struct wl_listener cursor_frame;
+  struct wlr_relative_pointer_manager_v1 *relative_pointer_manager;
+  bool cursor_motion_pending;
+  uint32_t cursor_motion_time;
 
   struct wl_listener new_input;
   struct wl_list keyboards;
+  struct wl_list keymaps;
+  int keymap_pipe[2];
+  struct wl_event_source *keymap_source;
 
   struct wl_listener new_output;
   struct wl_list outputs;
@@ -51,20 +95,103 @@ struct server {
   struct wl_listener new_xdg_toplevel;
   struct wl_listener new_xdg_popup;
   struct wl_list toplevels;
+  uint32_t last_toplevel_id;
+  int popups;
 
   struct wlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
 
+  struct wl_list children;
+
+  struct wl_listener client_created;
+  struct wl_list clients;
+  int clients_pending_present;
+  struct wl_list app_stats;
+  struct wl_protocol_logger *shm_logger;
+
+  char *panel_command;
   struct wl_client *panel_client;
   struct wl_listener panel_client_destroy;
+  struct child *panel_child;
+  struct wl_listener panel_exit;
+  struct wl_event_source *panel_restart_timer;
+  int panel_restart_msec;
+
+  struct startup startup;
+
+  struct {
+    /* The client with the foreground priority */
+    struct client *foreground;
+    /* Restoring a nice value was refused, which is only logged once */
+    bool denied;
+  } cpu;
+
+  /* The delegated cgroup v2 directory, and the compositor's leaf in it */
+  struct {
+    char *root;
+    char *compositor;
+    uint32_t last_id;
+  } cgroup;
+
+  struct {
+    bool enabled;
+    struct wl_event_source *timer;
+    int64_t update_nsec;
+    struct client *focused_client;
+    uint64_t focused_commits;
+  } hud;
+
+  struct {
+    int fd;
+    char *path;
+    struct wl_event_source *source;
+    struct wl_list connections;
+    int num_connections;
+  } metrics;
+
+  struct {
+    int fd;
+    char *path;
+    struct wl_event_source *source;
+    struct wl_list connections;
+    int num_connections;
+  } ipc;
+
+  struct {
+    int psi_fd;
+    /* Written by the thread watching psi_fd, and read by the event loop */
+    int event_fd;
+    int stop_fd;
+    pthread_t thread;
+    struct wl_event_source *source;
+    uint64_t events;
+    uint64_t closes;
+    uint64_t kills;
+  } lowmem;
+
+  struct {
+    int64_t start_nsec;
+    uint64_t commits;
+    uint64_t key_events;
+    uint64_t button_events;
+    uint64_t axis_events;
+    uint64_t motion_events;
+    uint64_t motion_coalesced;
+  } stats;
 
   struct server_sig const *sig;
 };
 DECLARE_TYPE(server)
 
+void server_flush_cursor_motion(struct server *server);
 bool server_handle_keybinding(struct server *server, xkb_keysym_t sym);
 
 void server_create_panel(struct server *server, char const *program);
 
-struct server *server_create(void);
+void server_print_stats(struct server *server, FILE *f);
+
+void server_run(struct server *server);
+void server_terminate(struct server *server);
+
+struct server *server_create(struct server_options const *options);
 
 #endif
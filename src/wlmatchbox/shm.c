@@ -0,0 +1,252 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "shm.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <wayland-server.h>
+#include <wlr/util/log.h>
+
+#include "client.h"
+#include "server.h"
+
+/* A pool, shm buffer or surface of a client being accounted */
+struct shm_resource {
+  struct wl_list link;
+  struct client *client;
+  enum shm_resource_type type;
+  uint64_t bytes;
+  struct wl_listener destroy;
+
+  /*
+   * wlroots keeps a pool mapped until its buffers are gone too, so a pool
+   * stays accounted until then. For a buffer, the pool it was created from
+   */
+  struct shm_resource *pool;
+  /* For a pool, its live buffers and whether the pool resource is gone */
+  int buffers;
+  bool released;
+
+  struct shm_resource_sig const *sig;
+};
+DECLARE_TYPE(shm_resource)
+DEFINE_TYPE(shm_resource)
+
+static void shm_account(struct client *client, enum shm_resource_type type,
+                        int count, int64_t bytes) {
+  uint64_t soft_limit = client->server->options.shm_soft_limit;
+
+  switch (type) {
+  case SHM_RESOURCE_POOL:
+    client->shm.pools += count;
+    client->shm.pool_bytes += bytes;
+    client->shm.over_soft_limit =
+        soft_limit && client->shm.pool_bytes > soft_limit;
+    break;
+  case SHM_RESOURCE_BUFFER:
+    client->shm.buffers += count;
+    client->shm.buffer_bytes += bytes;
+    break;
+  case SHM_RESOURCE_SURFACE:
+    client->shm.surfaces += count;
+    break;
+  }
+}
+
+static void shm_resource_free(struct shm_resource *res) {
+  struct shm_resource *pool = res->pool;
+
+  shm_account(res->client, res->type, -1, -(int64_t)res->bytes);
+  if (res->client->shm.pending_pool == res) {
+    res->client->shm.pending_pool = NULL;
+  }
+  wl_list_remove(&res->link);
+  wl_list_remove(&res->destroy.link);
+  free(res);
+
+  /* The last buffer of a pool that was already destroyed unmaps it */
+  if (pool && --pool->buffers == 0 && pool->released) {
+    shm_resource_free(pool);
+  }
+}
+
+static void shm_resource_destroy(struct wl_listener *listener, void *data) {
+  struct shm_resource *res =
+      get_type_ptr(shm_resource, listener, res, destroy);
+
+  if (res->type == SHM_RESOURCE_POOL && res->buffers) {
+    wl_list_remove(&res->destroy.link);
+    wl_list_init(&res->destroy.link);
+    res->released = true;
+    return;
+  }
+  shm_resource_free(res);
+}
+
+static struct shm_resource *shm_resource_from_resource(
+    struct wl_resource *resource) {
+  struct wl_listener *listener =
+      wl_resource_get_destroy_listener(resource, shm_resource_destroy);
+  if (!listener) {
+    return NULL;
+  }
+  struct shm_resource *res;
+  return check_sig_shm_resource(wl_container_of(listener, res, destroy));
+}
+
+static void shm_track(struct client *client, struct wl_resource *resource,
+                      enum shm_resource_type type, uint64_t bytes,
+                      struct shm_resource *pool) {
+  struct shm_resource *res = alloc_shm_resource();
+  res->client = client;
+  res->type = type;
+  res->bytes = bytes;
+  res->pool = pool;
+  if (pool) {
+    pool->buffers++;
+  }
+  res->destroy.notify = shm_resource_destroy;
+  wl_resource_add_destroy_listener(resource, &res->destroy);
+  wl_list_insert(&client->shm.resources, &res->link);
+  shm_account(client, type, 1, bytes);
+}
+
+static void shm_resource_created(struct wl_listener *listener, void *data) {
+  struct client *client =
+      get_type_ptr(client, listener, client, shm.resource_created);
+  struct wl_resource *resource = data;
+  char const *class = wl_resource_get_class(resource);
+
+  if (class == wl_surface_interface.name) {
+    shm_track(client, resource, SHM_RESOURCE_SURFACE, 0, NULL);
+  } else if (client->shm.pending_id &&
+             wl_resource_get_id(resource) == client->shm.pending_id) {
+    /* The pool or buffer of the request seen by the protocol logger */
+    shm_track(client, resource, client->shm.pending_type,
+              client->shm.pending_bytes, client->shm.pending_pool);
+    client->shm.pending_id = 0;
+  }
+}
+
+/*
+ * Check whether the pools of a client can grow by bytes. If they would go
+ * over the hard limit the client is disconnected.
+ */
+static bool shm_check_limits(struct client *client, uint64_t bytes) {
+  struct server_options const *options = &client->server->options;
+  uint64_t total = client->shm.pool_bytes + bytes;
+
+  if (options->shm_hard_limit && total > options->shm_hard_limit) {
+    wlr_log(WLR_ERROR,
+            "Client %d (%s) exceeded the shm limit with %" PRIu64 " MiB",
+            (int)client->pid, client->app_id ? client->app_id : "no toplevel",
+            total >> 20);
+    wl_client_post_implementation_error(
+        client->wl_client, "shared memory limit of %" PRIu64 " MiB exceeded",
+        options->shm_hard_limit >> 20);
+    return false;
+  }
+
+  /* Only log when it goes over, not on every allocation after that */
+  if (options->shm_soft_limit && total > options->shm_soft_limit &&
+      !client->shm.over_soft_limit) {
+    wlr_log(WLR_INFO,
+            "Client %d (%s) is over the shm soft limit with %" PRIu64 " MiB",
+            (int)client->pid, client->app_id ? client->app_id : "no toplevel",
+            total >> 20);
+  }
+  return true;
+}
+
+static void shm_protocol_logger(void *data,
+                                enum wl_protocol_logger_type direction,
+                                struct wl_protocol_logger_message const *msg) {
+  /* Called for every message, so rule out the rest as cheaply as possible */
+  if (direction != WL_PROTOCOL_LOGGER_REQUEST) {
+    return;
+  }
+  char const *class = wl_resource_get_class(msg->resource);
+  if (class != wl_shm_interface.name && class != wl_shm_pool_interface.name) {
+    return;
+  }
+
+  struct server *server = data;
+  struct client *client = client_from_wl_client(
+      server, wl_resource_get_client(msg->resource));
+  if (!client) {
+    return;
+  }
+  char const *name = msg->message->name;
+  union wl_argument const *args = msg->arguments;
+
+  if (class == wl_shm_interface.name && strcmp(name, "create_pool") == 0) {
+    /* new_id, fd, size */
+    uint64_t size = args[2].i > 0 ? args[2].i : 0;
+    if (shm_check_limits(client, size)) {
+      client->shm.pending_id = args[0].n;
+      client->shm.pending_type = SHM_RESOURCE_POOL;
+      client->shm.pending_bytes = size;
+      client->shm.pending_pool = NULL;
+    }
+  } else if (class == wl_shm_pool_interface.name &&
+             strcmp(name, "create_buffer") == 0) {
+    /* new_id, offset, width, height, stride, format */
+    client->shm.pending_id = args[0].n;
+    client->shm.pending_type = SHM_RESOURCE_BUFFER;
+    client->shm.pending_bytes = args[3].i > 0 && args[4].i > 0
+                                    ? (uint64_t)args[3].i * args[4].i
+                                    : 0;
+    client->shm.pending_pool = shm_resource_from_resource(msg->resource);
+  } else if (class == wl_shm_pool_interface.name &&
+             strcmp(name, "resize") == 0) {
+    struct shm_resource *res = shm_resource_from_resource(msg->resource);
+    if (!res) {
+      return;
+    }
+
+    /* Pools can only grow, anything else is an error wlroots reports */
+    uint64_t size = args[0].i > 0 ? args[0].i : 0;
+    if (size > res->bytes && shm_check_limits(client, size - res->bytes)) {
+      shm_account(client, SHM_RESOURCE_POOL, 0, size - res->bytes);
+      res->bytes = size;
+    }
+  }
+}
+
+void shm_init(struct server *server) {
+  server->shm_logger = wl_display_add_protocol_logger(
+      server->wl_display, shm_protocol_logger, server);
+}
+
+void shm_finish(struct server *server) {
+  if (server->shm_logger) {
+    wl_protocol_logger_destroy(server->shm_logger);
+    server->shm_logger = NULL;
+  }
+}
+
+void shm_client_init(struct client *client) {
+  wl_list_init(&client->shm.resources);
+  client->shm.resource_created.notify = shm_resource_created;
+  wl_client_add_resource_created_listener(client->wl_client,
+                                          &client->shm.resource_created);
+}
+
+void shm_client_destroy(struct client *client) {
+  /*
+   * The client's resources are only destroyed after its destroy signal, when
+   * the client is already gone, so stop following them now
+   */
+  struct shm_resource *res, *tmp;
+  wl_list_for_each(res, &client->shm.resources, link) {
+    /* All of them go, so freeing a buffer mustn't free its pool as well */
+    res->pool = NULL;
+  }
+  wl_list_for_each_safe(res, tmp, &client->shm.resources, link) {
+    shm_resource_free(res);
+  }
+  wl_list_remove(&client->shm.resource_created.link);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _SHM_H
+#define _SHM_H
+
+struct client;
+struct server;
+
+enum shm_resource_type {
+  SHM_RESOURCE_POOL,
+  SHM_RESOURCE_BUFFER,
+  SHM_RESOURCE_SURFACE,
+};
+
+/*
+ * Accounting of the memory each client shares with the compositor through
+ * wl_shm, and of its surfaces. The shm requests are seen through a protocol
+ * logger, before wlroots handles them, and the objects they create are
+ * followed with resource listeners.
+ *
+ * A client whose pools grow beyond server->options.shm_soft_limit is logged,
+ * and one whose pools would grow beyond server->options.shm_hard_limit is
+ * disconnected with a protocol error. 0 means no limit.
+ */
+void shm_init(struct server *server);
+void shm_finish(struct server *server);
+void shm_client_init(struct client *client);
+void shm_client_destroy(struct client *client);
+
+#endif
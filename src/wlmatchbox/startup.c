@@ -0,0 +1,103 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "startup.h"
+
+#include <wlr/util/log.h>
+
+#include "server.h"
+
+void startup_phase(struct server *server, char const *name) {
+  struct startup *startup = &server->startup;
+  if (startup->num_phases >= STARTUP_MAX_PHASES) {
+    return;
+  }
+  startup->phases[startup->num_phases++] = (struct startup_phase){
+      .name = name,
+      .end_nsec = get_time_nsec(),
+  };
+}
+
+static double msec_since_start(struct startup const *startup, int64_t nsec) {
+  return (double)(nsec - startup->start_nsec) / NSEC_PER_MSEC;
+}
+
+static void startup_format(struct startup const *startup, char *buf,
+                           size_t size) {
+  size_t len = 0;
+  int64_t last_nsec = startup->start_nsec;
+
+#define append(...)                                                            \
+  do {                                                                         \
+    if (len < size) {                                                          \
+      len += snprintf(buf + len, size - len, __VA_ARGS__);                     \
+    }                                                                          \
+  } while (0)
+
+  buf[0] = '\0';
+  for (int i = 0; i < startup->num_phases; i++) {
+    struct startup_phase const *phase = &startup->phases[i];
+    append("%s%s %.1f ms", i ? ", " : "", phase->name,
+           (double)(phase->end_nsec - last_nsec) / NSEC_PER_MSEC);
+    last_nsec = phase->end_nsec;
+  }
+
+  if (startup->first_frame_nsec) {
+    append("; first frame at %.1f ms",
+           msec_since_start(startup, startup->first_frame_nsec));
+  }
+  if (startup->panel_frame_nsec) {
+    append("; panel mapped at %.1f ms, on screen at %.1f ms",
+           msec_since_start(startup, startup->panel_map_nsec),
+           msec_since_start(startup, startup->panel_frame_nsec));
+  }
+
+#undef append
+}
+
+static void startup_report(struct server *server) {
+  struct startup *startup = &server->startup;
+  char buf[1024];
+
+  startup->reported = true;
+  startup_format(startup, buf, sizeof(buf));
+
+  int64_t ready_nsec = startup->panel_frame_nsec ? startup->panel_frame_nsec
+                                                 : startup->first_frame_nsec;
+  if (ready_nsec - startup->start_nsec > STARTUP_BUDGET_NSEC) {
+    wlr_log(WLR_ERROR, "Startup over budget: %s", buf);
+  } else {
+    wlr_log(WLR_INFO, "Startup: %s", buf);
+  }
+}
+
+void startup_output_commit(struct server *server) {
+  struct startup *startup = &server->startup;
+  int64_t now = get_time_nsec();
+
+  if (!startup->first_frame_nsec) {
+    startup->first_frame_nsec = now;
+  }
+  if (startup->panel_map_nsec && !startup->panel_frame_nsec) {
+    startup->panel_frame_nsec = now;
+  }
+
+  /* Wait for the panel to be on screen if there is one */
+  if (!server->panel_command || startup->panel_frame_nsec) {
+    startup_report(server);
+  }
+}
+
+void startup_panel_map(struct server *server) {
+  if (!server->startup.panel_map_nsec) {
+    server->startup.panel_map_nsec = get_time_nsec();
+  }
+}
+
+void startup_print(struct server *server, FILE *f) {
+  char buf[1024];
+  startup_format(&server->startup, buf, sizeof(buf));
+  fprintf(f, "startup: %s\n", buf);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server.h>
+
+#include "util.h"
+
+#define STARTUP_MAX_PHASES (16)
+
+/* Time from main() to the first frame with the panel on screen */
+#define STARTUP_BUDGET_NSEC (NSEC_PER_SEC)
+
+struct server;
+
+struct startup_phase {
+  char const *name;
+  int64_t end_nsec;
+};
+
+struct startup {
+  int64_t start_nsec;
+  int num_phases;
+  struct startup_phase phases[STARTUP_MAX_PHASES];
+
+  int64_t first_frame_nsec;
+  int64_t panel_map_nsec;
+  int64_t panel_frame_nsec;
+  bool reported;
+};
+
+/* Mark the end of a startup phase that began when the previous one ended */
+void startup_phase(struct server *server, char const *name);
+void startup_output_commit(struct server *server);
+void startup_panel_map(struct server *server);
+void startup_print(struct server *server, FILE *f);
+
+#endif
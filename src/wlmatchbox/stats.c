@@ -0,0 +1,99 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "stats.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "util.h"
+
+static unsigned int bucket_index(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+
+  unsigned int msb = 63 - __builtin_clzll(value);
+  if (msb >= HISTOGRAM_MAX_BITS) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  unsigned int sub = (value >> (msb - 4)) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return HISTOGRAM_SUB_BUCKETS * (msb - 3) + sub;
+}
+
+static uint64_t bucket_midpoint(unsigned int index) {
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+
+  unsigned int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+  uint64_t lower = (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+  return lower + ((UINT64_C(1) << shift) >> 1);
+}
+
+void histogram_reset(struct histogram *h) { memset(h, 0, sizeof(*h)); }
+
+void histogram_add(struct histogram *h, uint64_t value) {
+  if (!h->count || value < h->min) {
+    h->min = value;
+  }
+  if (value > h->max) {
+    h->max = value;
+  }
+  h->count++;
+  h->sum += value;
+  h->buckets[bucket_index(value)]++;
+}
+
+/*
+ * Number of samples less than or equal to value. Samples in the same bucket as
+ * value are all counted, so this can over count by up to one bucket width.
+ */
+uint64_t histogram_count_le(struct histogram const *h, uint64_t value) {
+  uint64_t count = 0;
+  unsigned int last = bucket_index(value);
+  for (unsigned int i = 0; i <= last; i++) {
+    count += h->buckets[i];
+  }
+  return count;
+}
+
+uint64_t histogram_percentile(struct histogram const *h, double percentile) {
+  if (!h->count) {
+    return 0;
+  }
+
+  uint64_t rank = ceil(percentile / 100.0 * h->count);
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = bucket_midpoint(i);
+      if (value < h->min) {
+        return h->min;
+      }
+      if (value > h->max) {
+        return h->max;
+      }
+      return value;
+    }
+  }
+  return h->max;
+}
+
+void histogram_print_msec(struct histogram const *h, FILE *f,
+                          char const *name) {
+  double const scale = NSEC_PER_MSEC;
+  fprintf(f,
+          "  %s: %" PRIu64 " samples, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+          name, h->count, histogram_percentile(h, 50) / scale,
+          histogram_percentile(h, 99) / scale, h->max / scale);
+}
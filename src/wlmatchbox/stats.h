@@ -0,0 +1,37 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Log-linear histogram. Values below 16 get their own bucket, and every power
+ * of two above that is split into 16 linear sub-buckets, which keeps the
+ * relative error of any percentile under ~6% with a fixed amount of memory.
+ */
+#define HISTOGRAM_SUB_BUCKETS (16)
+#define HISTOGRAM_MAX_BITS (40)
+#define HISTOGRAM_BUCKETS                                                      \
+  (HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_BITS - 3))
+
+struct histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_reset(struct histogram *h);
+void histogram_add(struct histogram *h, uint64_t value);
+uint64_t histogram_count_le(struct histogram const *h, uint64_t value);
+uint64_t histogram_percentile(struct histogram const *h, double percentile);
+void histogram_print_msec(struct histogram const *h, FILE *f,
+                          char const *name);
+
+#endif
@@ -8,11 +8,18 @@
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/box.h>
 
+#include "client.h"
+#include "freezer.h"
 #include "output.h"
+#include "priority.h"
+#include "probes.h"
 #include "server.h"
+#include "trace.h"
 
 DEFINE_TYPE(toplevel)
 
@@ -21,22 +28,31 @@ static bool is_panel(struct toplevel *toplevel) {
          toplevel->server->panel_client;
 }
 
+static struct client *toplevel_client(struct toplevel *toplevel) {
+  return client_from_wl_client(
+      toplevel->server,
+      wl_resource_get_client(toplevel->xdg_toplevel->resource));
+}
+
+static inline char const *toplevel_app_id(struct toplevel *toplevel) {
+  char const *app_id = toplevel->xdg_toplevel->app_id;
+  return app_id ? app_id : "";
+}
+
 static struct toplevel *
-toplevel_try_from_wlr_surface(struct server *server,
-                              struct wlr_surface *surface) {
+toplevel_try_from_wlr_surface(struct wlr_surface *surface) {
   struct wlr_xdg_toplevel *xdg_toplevel =
       wlr_xdg_toplevel_try_from_wlr_surface(surface);
-  if (!xdg_toplevel) {
+  if (!xdg_toplevel || !xdg_toplevel->base->data) {
     return NULL;
   }
-  struct toplevel *toplevel;
-  wl_list_for_each(toplevel, &server->toplevels, link) {
-    if (toplevel->xdg_toplevel == xdg_toplevel) {
-      return toplevel;
-    }
-  }
 
-  return NULL;
+  /*
+   * The xdg surface data points to the toplevel scene tree, and the scene
+   * tree data points back to the toplevel
+   */
+  struct wlr_scene_tree *scene_tree = xdg_toplevel->base->data;
+  return check_sig_toplevel(scene_tree->node.data);
 }
 
 static void toplevel_configure(struct toplevel *toplevel) {
@@ -49,6 +65,17 @@ static void toplevel_configure(struct toplevel *toplevel) {
     if (toplevel->output) {
       req_width = toplevel->output->wlr_output->width - 1;
     }
+  } else if (toplevel->fullscreen) {
+    /*
+     * Fullscreen windows cover the whole output (including the panel) so
+     * that their buffer can be scanned out directly
+     */
+    if (toplevel->output) {
+      req_width = toplevel->output->wlr_output->width;
+      req_height = toplevel->output->wlr_output->height;
+    }
+    wlr_xdg_toplevel_set_maximized(toplevel->xdg_toplevel, false);
+    wlr_xdg_toplevel_set_fullscreen(toplevel->xdg_toplevel, true);
   } else {
     if (toplevel->output) {
       req_width = toplevel->output->wlr_output->width - 1;
@@ -61,14 +88,22 @@ static void toplevel_configure(struct toplevel *toplevel) {
         req_height -= box.height;
       }
     }
+    wlr_xdg_toplevel_set_fullscreen(toplevel->xdg_toplevel, false);
     wlr_xdg_toplevel_set_maximized(toplevel->xdg_toplevel, true);
   }
 
-  wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, req_width, req_height);
+  uint32_t serial =
+      wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, req_width, req_height);
+  trace_instant("toplevel", "configure", "serial", serial);
+  PROBE4(configure, toplevel_app_id(toplevel), req_width, req_height, serial);
+  toplevel->configured.width = req_width;
+  toplevel->configured.height = req_height;
 
   if (toplevel->foreign.handle) {
     wlr_foreign_toplevel_handle_v1_set_maximized(toplevel->foreign.handle,
-                                                 true);
+                                                 !toplevel->fullscreen);
+    wlr_foreign_toplevel_handle_v1_set_fullscreen(toplevel->foreign.handle,
+                                                  toplevel->fullscreen);
   }
 
   if (toplevel->output) {
@@ -84,6 +119,12 @@ static void toplevel_configure(struct toplevel *toplevel) {
 static void xdg_toplevel_map(struct wl_listener *listener, void *data) {
   struct toplevel *toplevel = get_type_ptr(toplevel, listener, toplevel, map);
   wl_list_insert(&toplevel->server->toplevels, &toplevel->link);
+  trace_instant("toplevel", "map", NULL, 0);
+
+  if (is_panel(toplevel)) {
+    startup_panel_map(toplevel->server);
+  }
+  client_toplevel_map(toplevel);
 
   toplevel_focus(toplevel);
 }
@@ -91,15 +132,35 @@ static void xdg_toplevel_map(struct wl_listener *listener, void *data) {
 static void xdg_toplevel_unmap(struct wl_listener *listener, void *data) {
   struct toplevel *toplevel = get_type_ptr(toplevel, listener, toplevel, unmap);
   wl_list_remove(&toplevel->link);
+  trace_instant("toplevel", "unmap", NULL, 0);
+
+  if (toplevel->output) {
+    output_update_visibility(toplevel->output);
+  }
+  /* The client's other toplevels may all be hidden now */
+  freezer_update(toplevel_client(toplevel));
 }
 
 static void xdg_toplevel_commit(struct wl_listener *listener, void *data) {
   struct toplevel *toplevel =
       get_type_ptr(toplevel, listener, toplevel, commit);
 
+  toplevel->server->stats.commits++;
+  client_surface_commit(toplevel->server,
+                        toplevel->xdg_toplevel->base->surface);
+  trace_instant("toplevel", "commit", NULL, 0);
+  PROBE2(commit, toplevel_app_id(toplevel),
+         toplevel->xdg_toplevel->base->surface);
+
   if (toplevel->xdg_toplevel->base->initial_commit) {
     toplevel_configure(toplevel);
   }
+
+  /* Windows below this one may have been covered or exposed by a resize */
+  if (toplevel->output &&
+      toplevel_covers_output(toplevel) != toplevel->covers_output) {
+    output_update_visibility(toplevel->output);
+  }
 }
 
 static void xdg_toplevel_destroy(struct wl_listener *listener, void *data) {
@@ -134,13 +195,42 @@ static void xdg_toplevel_request_maximize(struct wl_listener *listener,
   }
 }
 
+static void toplevel_set_fullscreen(struct toplevel *toplevel, bool fullscreen,
+                                    struct wlr_output *wlr_output) {
+  if (is_panel(toplevel)) {
+    fullscreen = false;
+  }
+  toplevel->fullscreen = fullscreen;
+
+  if (fullscreen && wlr_output &&
+      (!toplevel->output || toplevel->output->wlr_output != wlr_output)) {
+    struct output *output;
+    wl_list_for_each(output, &toplevel->server->outputs, link) {
+      if (output->wlr_output == wlr_output) {
+        /* This also configures the toplevel */
+        toplevel_assign_output(toplevel, output);
+        return;
+      }
+    }
+  }
+
+  if (toplevel->xdg_toplevel->base->initialized) {
+    toplevel_configure(toplevel);
+    wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
+  }
+  if (toplevel->output) {
+    output_update_visibility(toplevel->output);
+  }
+}
+
 static void xdg_toplevel_request_fullscreen(struct wl_listener *listener,
                                             void *data) {
   struct toplevel *toplevel =
       get_type_ptr(toplevel, listener, toplevel, request_fullscreen);
-  if (toplevel->xdg_toplevel->base->initialized) {
-    wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
-  }
+  struct wlr_xdg_toplevel_requested *requested =
+      &toplevel->xdg_toplevel->requested;
+  toplevel_set_fullscreen(toplevel, requested->fullscreen,
+                          requested->fullscreen_output);
 }
 
 static void xdg_toplevel_set_app_id(struct wl_listener *listener, void *data) {
@@ -172,6 +262,8 @@ static void toplevel_foreign_request_minimize(struct wl_listener *listener,
                                               void *data) {
   struct toplevel *toplevel =
       get_type_ptr(toplevel, listener, toplevel, foreign.request_minimize);
+  struct wlr_foreign_toplevel_handle_v1_minimized_event *event = data;
+  toplevel_set_minimized(toplevel, event->minimized);
 }
 
 static void toplevel_foreign_request_activate(struct wl_listener *listener,
@@ -185,12 +277,15 @@ static void toplevel_foreign_request_fullscreen(struct wl_listener *listener,
                                                 void *data) {
   struct toplevel *toplevel =
       get_type_ptr(toplevel, listener, toplevel, foreign.request_fullscreen);
+  struct wlr_foreign_toplevel_handle_v1_fullscreen_event *event = data;
+  toplevel_set_fullscreen(toplevel, event->fullscreen, event->output);
 }
 
 static void toplevel_foreign_request_close(struct wl_listener *listener,
                                            void *data) {
   struct toplevel *toplevel =
       get_type_ptr(toplevel, listener, toplevel, foreign.request_close);
+  toplevel_close(toplevel);
 }
 
 static void toplevel_foreign_destroy(struct wl_listener *listener, void *data) {
@@ -210,8 +305,9 @@ void toplevel_create(struct server *server,
   struct toplevel *toplevel = alloc_toplevel();
   toplevel->server = server;
   toplevel->xdg_toplevel = xdg_toplevel;
+  toplevel->id = ++server->last_toplevel_id;
   toplevel->scene_tree = wlr_scene_xdg_surface_create(
-      &toplevel->server->scene->tree, xdg_toplevel->base);
+      toplevel->server->layers.toplevels, xdg_toplevel->base);
   toplevel->scene_tree->node.data = toplevel;
 
   // The data pointer must be set to the scene tree for popups to
@@ -268,7 +364,20 @@ void toplevel_create(struct server *server,
   }
 }
 
+static void toplevel_update_suspended(struct toplevel *toplevel) {
+  bool suspended = toplevel->occluded || toplevel->minimized ||
+                   !toplevel->output || !toplevel->output->wlr_output->enabled;
+
+  if (suspended != toplevel->suspended &&
+      toplevel->xdg_toplevel->base->initialized) {
+    toplevel->suspended = suspended;
+    wlr_xdg_toplevel_set_suspended(toplevel->xdg_toplevel, suspended);
+  }
+  freezer_update(toplevel_client(toplevel));
+}
+
 void toplevel_assign_output(struct toplevel *toplevel, struct output *output) {
+  struct output *prev_output = toplevel->output;
   if (is_panel(toplevel)) {
     if (toplevel->output) {
       toplevel->output->panel = NULL;
@@ -280,6 +389,11 @@ void toplevel_assign_output(struct toplevel *toplevel, struct output *output) {
     toplevel_configure(toplevel);
     wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
   }
+
+  if (prev_output && prev_output != output) {
+    output_update_visibility(prev_output);
+  }
+  output_update_visibility(output);
 }
 
 void toplevel_assign_any_output(struct toplevel *toplevel) {
@@ -291,8 +405,11 @@ void toplevel_assign_any_output(struct toplevel *toplevel) {
   struct output *output;
   wl_list_for_each_reverse(output, &toplevel->server->outputs, link) {
     toplevel_assign_output(toplevel, output);
-    break;
+    return;
   }
+
+  /* There are no outputs left to show it on */
+  toplevel_update_suspended(toplevel);
 }
 
 void toplevel_focus(struct toplevel *toplevel) {
@@ -308,6 +425,17 @@ void toplevel_focus(struct toplevel *toplevel) {
     /* Don't re-focus an already focused surface. */
     return;
   }
+  int64_t trace_start = trace_begin();
+  PROBE1(focus, toplevel_app_id(toplevel));
+  /* Let a frozen client handle the focus change straight away */
+  freezer_thaw(toplevel_client(toplevel));
+  if (toplevel->minimized) {
+    toplevel->minimized = false;
+    if (toplevel->foreign.handle) {
+      wlr_foreign_toplevel_handle_v1_set_minimized(toplevel->foreign.handle,
+                                                   false);
+    }
+  }
   if (prev_surface) {
     /*
      * Deactivate the previously focused surface. This lets the
@@ -315,7 +443,7 @@ void toplevel_focus(struct toplevel *toplevel) {
      * repaint accordingly, e.g. stop displaying a caret.
      */
     struct toplevel *prev_toplevel =
-        toplevel_try_from_wlr_surface(server, prev_surface);
+        toplevel_try_from_wlr_surface(prev_surface);
     if (prev_toplevel != NULL) {
       wlr_xdg_toplevel_set_activated(prev_toplevel->xdg_toplevel, false);
       if (prev_toplevel->foreign.handle) {
@@ -329,6 +457,9 @@ void toplevel_focus(struct toplevel *toplevel) {
   wlr_scene_node_raise_to_top(&toplevel->scene_tree->node);
   wl_list_remove(&toplevel->link);
   wl_list_insert(&server->toplevels, &toplevel->link);
+  if (toplevel->output) {
+    output_update_visibility(toplevel->output);
+  }
   /* Activate the new surface */
   wlr_xdg_toplevel_set_activated(toplevel->xdg_toplevel, true);
   if (toplevel->foreign.handle) {
@@ -345,13 +476,103 @@ void toplevel_focus(struct toplevel *toplevel) {
                                    keyboard->num_keycodes,
                                    &keyboard->modifiers);
   }
+  toplevel_update_suspended(toplevel);
+  toplevel->focus_nsec = get_time_nsec();
+  struct client *client = toplevel_client(toplevel);
+  if (client) {
+    /* It is wanted after all, so don't kill it if it didn't close */
+    client->lowmem_close_nsec = 0;
+  }
+  if (!is_panel(toplevel)) {
+    priority_focus(server, client);
+  }
+  trace_end("toplevel", "focus", trace_start, NULL, 0);
 }
 
-struct toplevel *toplevel_at(struct server *server, double lx, double ly,
-                             struct wlr_surface **surface, double *sx,
-                             double *sy) {
-  struct wlr_scene_node *node =
-      wlr_scene_node_at(&server->scene->tree.node, lx, ly, sx, sy);
+bool toplevel_covers_output(struct toplevel *toplevel) {
+  /*
+   * Like matchbox, windows are treated as opaque, so a window that has taken
+   * on the full size it was configured with hides everything below it
+   */
+  struct wlr_xdg_surface *base = toplevel->xdg_toplevel->base;
+  return base->surface->mapped && toplevel->configured.width > 0 &&
+         toplevel->configured.height > 0 &&
+         base->geometry.width >= toplevel->configured.width &&
+         base->geometry.height >= toplevel->configured.height;
+}
+
+void toplevel_set_occluded(struct toplevel *toplevel, bool occluded) {
+  toplevel->occluded = occluded;
+  wlr_scene_node_set_enabled(&toplevel->scene_tree->node,
+                             !occluded && !toplevel->minimized);
+  toplevel_update_suspended(toplevel);
+}
+
+void toplevel_set_minimized(struct toplevel *toplevel, bool minimized) {
+  struct server *server = toplevel->server;
+
+  if (is_panel(toplevel) || toplevel->minimized == minimized ||
+      !toplevel->xdg_toplevel->base->surface->mapped) {
+    return;
+  }
+
+  if (!minimized) {
+    toplevel_focus(toplevel);
+    return;
+  }
+
+  toplevel->minimized = true;
+  if (toplevel->foreign.handle) {
+    wlr_foreign_toplevel_handle_v1_set_minimized(toplevel->foreign.handle,
+                                                 true);
+  }
+  wlr_xdg_toplevel_set_activated(toplevel->xdg_toplevel, false);
+
+  /* Minimized windows go to the bottom of the stack */
+  wl_list_remove(&toplevel->link);
+  wl_list_insert(server->toplevels.prev, &toplevel->link);
+  if (toplevel->output) {
+    output_update_visibility(toplevel->output);
+  }
+
+  if (server->seat->keyboard_state.focused_surface ==
+      toplevel->xdg_toplevel->base->surface) {
+    /* Give the focus to the next window that isn't minimized */
+    struct toplevel *next;
+    wl_list_for_each(next, &server->toplevels, link) {
+      if (!next->minimized && !is_panel(next)) {
+        toplevel_focus(next);
+        return;
+      }
+    }
+    wlr_seat_keyboard_notify_clear_focus(server->seat);
+  }
+}
+
+void toplevel_close(struct toplevel *toplevel) {
+  /* A frozen client couldn't handle the request */
+  struct client *client = toplevel_client(toplevel);
+  freezer_thaw(client);
+  wlr_xdg_toplevel_send_close(toplevel->xdg_toplevel);
+  /* It is frozen again after the grace period if it ignores it */
+  freezer_update(client);
+}
+
+struct toplevel *toplevel_from_id(struct server *server, uint32_t id) {
+  struct toplevel *toplevel;
+  wl_list_for_each(toplevel, &server->toplevels, link) {
+    if (toplevel->id == id) {
+      return toplevel;
+    }
+  }
+  return NULL;
+}
+
+static struct toplevel *toplevel_at_node(struct wlr_scene_node *root,
+                                         double lx, double ly,
+                                         struct wlr_surface **surface,
+                                         double *sx, double *sy) {
+  struct wlr_scene_node *node = wlr_scene_node_at(root, lx, ly, sx, sy);
   if (node == NULL || node->type != WLR_SCENE_NODE_BUFFER) {
     return NULL;
   }
@@ -368,6 +589,40 @@ struct toplevel *toplevel_at(struct server *server, double lx, double ly,
   while (tree != NULL && tree->node.data == NULL) {
     tree = tree->node.parent;
   }
-  return tree->node.data;
+  return tree ? tree->node.data : NULL;
 }
 
+struct toplevel *toplevel_at(struct server *server, double lx, double ly,
+                             struct wlr_surface **surface, double *sx,
+                             double *sy) {
+  /*
+   * Fast path: the focused toplevel is on top of the scene, and when it
+   * covers its output everything else on that output except the panel is
+   * hidden. Only its own subtree (which includes its popups) and the panel
+   * need to be checked, no matter how many windows are open.
+   */
+  if (!wl_list_empty(&server->toplevels)) {
+    struct toplevel *focused =
+        wl_container_of(server->toplevels.next, focused, link);
+    struct output *output = focused->output;
+
+    if (output && focused->covers_output) {
+      struct wlr_box box;
+      wlr_output_layout_get_box(server->output_layout, output->wlr_output,
+                                &box);
+      if (wlr_box_contains_point(&box, lx, ly)) {
+        struct toplevel *toplevel = toplevel_at_node(
+            &focused->scene_tree->node, lx, ly, surface, sx, sy);
+        if (!toplevel && output->panel &&
+            output->panel->scene_tree->node.enabled) {
+          toplevel = toplevel_at_node(&output->panel->scene_tree->node, lx,
+                                      ly, surface, sx, sy);
+        }
+        return toplevel;
+      }
+    }
+  }
+
+  return toplevel_at_node(&server->layers.toplevels->node, lx, ly, surface, sx,
+                          sy);
+}
@@ -17,6 +17,7 @@ struct toplevel {
   struct server *server;
   struct wlr_xdg_toplevel *xdg_toplevel;
   struct wlr_scene_tree *scene_tree;
+  uint32_t id;
   struct wl_listener map;
   struct wl_listener unmap;
   struct wl_listener commit;
@@ -37,6 +38,18 @@ struct toplevel {
   } foreign;
 
   struct output *output;
+  bool fullscreen;
+  int64_t focus_nsec;
+
+  struct {
+    int32_t width;
+    int32_t height;
+  } configured;
+  bool covers_output;
+  bool occluded;
+  bool minimized;
+  /* Clients that bound xdg_wm_base v6 are told while they can't be seen */
+  bool suspended;
 
   struct toplevel_sig const *sig;
 };
@@ -47,6 +60,11 @@ void toplevel_create(struct server *server,
 void toplevel_assign_output(struct toplevel *toplevel, struct output *output);
 void toplevel_assign_any_output(struct toplevel *toplevel);
 void toplevel_focus(struct toplevel *toplevel);
+bool toplevel_covers_output(struct toplevel *toplevel);
+void toplevel_set_occluded(struct toplevel *toplevel, bool occluded);
+void toplevel_set_minimized(struct toplevel *toplevel, bool minimized);
+void toplevel_close(struct toplevel *toplevel);
+struct toplevel *toplevel_from_id(struct server *server, uint32_t id);
 
 struct toplevel *toplevel_at(struct server *server, double lx, double ly,
                              struct wlr_surface **surface, double *sx,
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "trace.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+bool trace_enabled = false;
+
+static struct {
+  struct trace_event *events;
+  size_t size;
+  /* Total number of events ever recorded; the ring holds the last size */
+  uint64_t count;
+  char *path;
+} trace;
+
+bool trace_init(size_t num_events, char const *path) {
+  if (!num_events) {
+    num_events = TRACE_DEFAULT_EVENTS;
+  }
+
+  trace.events = calloc(num_events, sizeof(*trace.events));
+  if (!trace.events) {
+    wlr_log(WLR_ERROR, "Unable to allocate trace buffer of %zu events",
+            num_events);
+    return false;
+  }
+  trace.size = num_events;
+  trace.count = 0;
+  trace.path = strdup(path);
+  trace_enabled = true;
+
+  wlr_log(WLR_INFO, "Tracing the last %zu events to %s", num_events, path);
+  return true;
+}
+
+void trace_record(enum trace_type type, char const *category, char const *name,
+                  int64_t ts_nsec, int64_t dur_nsec, char const *arg_name,
+                  int64_t arg) {
+  struct trace_event *event = &trace.events[trace.count++ % trace.size];
+  event->ts_nsec = ts_nsec;
+  event->dur_nsec = dur_nsec;
+  event->category = category;
+  event->name = name;
+  event->arg_name = arg_name;
+  event->arg = arg;
+  event->type = type;
+}
+
+static void write_event(FILE *f, struct trace_event const *event, pid_t pid,
+                        bool first) {
+  fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,",
+          first ? "" : ",", event->name, event->category, pid, pid);
+
+  /* Timestamps are in microseconds */
+  switch (event->type) {
+  case TRACE_SPAN:
+    fprintf(f, "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+            event->ts_nsec / 1000.0, event->dur_nsec / 1000.0);
+    break;
+  case TRACE_INSTANT:
+    fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f",
+            event->ts_nsec / 1000.0);
+    break;
+  }
+
+  if (event->arg_name) {
+    fprintf(f, ",\"args\":{\"%s\":%" PRId64 "}", event->arg_name, event->arg);
+  }
+  fprintf(f, "}");
+}
+
+bool trace_dump(void) {
+  if (!trace_enabled) {
+    return false;
+  }
+
+  /* Write to a temporary file so a reader never sees a partial trace */
+  char tmp_path[4096];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", trace.path);
+  FILE *f = fopen(tmp_path, "w");
+  if (!f) {
+    wlr_log_errno(WLR_ERROR, "Unable to open %s", tmp_path);
+    return false;
+  }
+
+  pid_t pid = getpid();
+  uint64_t first = trace.count > trace.size ? trace.count - trace.size : 0;
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (uint64_t i = first; i < trace.count; i++) {
+    write_event(f, &trace.events[i % trace.size], pid, i == first);
+  }
+  fprintf(f, "\n]}\n");
+
+  if (fclose(f) != 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to write %s", tmp_path);
+    unlink(tmp_path);
+    return false;
+  }
+  if (rename(tmp_path, trace.path) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to rename %s", tmp_path);
+    unlink(tmp_path);
+    return false;
+  }
+
+  wlr_log(WLR_INFO, "Wrote %" PRIu64 " trace events to %s",
+          trace.count - first, trace.path);
+  return true;
+}
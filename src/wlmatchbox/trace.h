@@ -0,0 +1,79 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+#include "util.h"
+
+/*
+ * In-process trace recorder. Events are written into a preallocated ring
+ * buffer (the oldest events are overwritten) and dumped as Chrome trace event
+ * JSON, which chrome://tracing and Perfetto can load.
+ *
+ * All names must be string literals (or otherwise live forever), since only
+ * the pointers are recorded. When tracing is disabled every trace call is a
+ * single predictable branch on a global flag.
+ */
+
+#define TRACE_DEFAULT_EVENTS (64 * 1024)
+
+enum trace_type {
+  TRACE_SPAN,
+  TRACE_INSTANT,
+};
+
+struct trace_event {
+  int64_t ts_nsec;
+  int64_t dur_nsec;
+  char const *category;
+  char const *name;
+  char const *arg_name;
+  int64_t arg;
+  enum trace_type type;
+};
+
+extern bool trace_enabled;
+
+bool trace_init(size_t num_events, char const *path);
+bool trace_dump(void);
+
+void trace_record(enum trace_type type, char const *category, char const *name,
+                  int64_t ts_nsec, int64_t dur_nsec, char const *arg_name,
+                  int64_t arg);
+
+/* Returns the start time of a span, to be passed to trace_end() */
+static inline int64_t trace_begin(void) {
+  if (__builtin_expect(!trace_enabled, 1)) {
+    return 0;
+  }
+  return get_time_nsec();
+}
+
+static inline void trace_end(char const *category, char const *name,
+                             int64_t start_nsec, char const *arg_name,
+                             int64_t arg) {
+  if (__builtin_expect(!trace_enabled, 1)) {
+    return;
+  }
+  trace_record(TRACE_SPAN, category, name, start_nsec,
+               get_time_nsec() - start_nsec, arg_name, arg);
+}
+
+static inline void trace_instant(char const *category, char const *name,
+                                 char const *arg_name, int64_t arg) {
+  if (__builtin_expect(!trace_enabled, 1)) {
+    return;
+  }
+  trace_record(TRACE_INSTANT, category, name, get_time_nsec(), 0, arg_name,
+               arg);
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "unix_socket.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+
+int unix_socket_listen(char const *path, int backlog) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    wlr_log(WLR_ERROR, "Socket path %s is too long", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to create socket");
+    return -1;
+  }
+
+  /* Replace a stale socket, but nothing else that is in the way */
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      wlr_log(WLR_ERROR, "%s exists and isn't a socket", path);
+      close(fd);
+      return -1;
+    }
+    unlink(path);
+  }
+
+  /* Only the user running the compositor may connect */
+  mode_t old_umask = umask(0177);
+  int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  umask(old_umask);
+  if (ret < 0 || listen(fd, backlog) < 0) {
+    wlr_log_errno(WLR_ERROR, "Unable to listen on %s", path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
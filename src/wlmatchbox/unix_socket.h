@@ -0,0 +1,16 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _UNIX_SOCKET_H
+#define _UNIX_SOCKET_H
+
+/*
+ * Create a non-blocking Unix stream socket listening on path, which only the
+ * current user can connect to. A stale socket at path is replaced. Returns the
+ * socket or -1 on error.
+ */
+int unix_socket_listen(char const *path, int backlog);
+
+#endif
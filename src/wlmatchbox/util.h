@@ -9,6 +9,10 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+#include "watchdog.h"
 
 #define DECLARE_TYPE(_type)                                                    \
   struct _type##_sig {                                                         \
@@ -27,8 +31,10 @@
 
 #define DEFINE_TYPE(_type) struct _type##_sig const _type##_sig;
 
+/* Used by every listener to find its object, so it also marks the handler */
 #define get_type_ptr(_type, _ptr, _sample, _member)                            \
-  check_sig_##_type(wl_container_of(_ptr, _sample, _member))
+  (watchdog_mark(#_type "." #_member),                                         \
+   check_sig_##_type(wl_container_of(_ptr, _sample, _member)))
 
 static inline void bind_clbk(struct wl_listener *listener,
                              struct wl_signal *signal, wl_notify_func_t clbk) {
@@ -36,4 +42,18 @@ static inline void bind_clbk(struct wl_listener *listener,
   wl_signal_add(signal, listener);
 }
 
+#define NSEC_PER_SEC (INT64_C(1000000000))
+#define NSEC_PER_MSEC (INT64_C(1000000))
+#define NSEC_PER_USEC (INT64_C(1000))
+
+static inline int64_t timespec_to_nsec(struct timespec const *ts) {
+  return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline int64_t get_time_nsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return timespec_to_nsec(&now);
+}
+
 #endif
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include "watchdog.h"
+
+#include <inttypes.h>
+#include <wlr/util/log.h>
+
+#include "trace.h"
+#include "util.h"
+
+/* Number of distinct handlers that stalls are tracked for */
+#define WATCHDOG_MAX_HANDLERS (64)
+/* Number of handlers listed in the report */
+#define WATCHDOG_REPORT_HANDLERS (10)
+
+struct watchdog_handler {
+  char const *name;
+  uint64_t stalls;
+  int64_t total_nsec;
+  int64_t max_nsec;
+  int64_t last_nsec;
+};
+
+bool watchdog_enabled = false;
+
+static struct {
+  int64_t threshold_nsec;
+
+  /* The segment of the current dispatch being timed */
+  char const *name;
+  int64_t segment_nsec;
+  int64_t dispatch_nsec;
+
+  uint64_t dispatches;
+  uint64_t dispatch_stalls;
+  int64_t dispatch_max_nsec;
+
+  struct watchdog_handler handlers[WATCHDOG_MAX_HANDLERS];
+  size_t num_handlers;
+  uint64_t untracked_stalls;
+} watchdog;
+
+void watchdog_init(int64_t threshold_nsec) {
+  watchdog.threshold_nsec = threshold_nsec;
+  watchdog_enabled = threshold_nsec > 0;
+}
+
+static void watchdog_stall(char const *name, int64_t start_nsec,
+                           int64_t dur_nsec) {
+  struct watchdog_handler *handler = NULL;
+  for (size_t i = 0; i < watchdog.num_handlers; i++) {
+    if (watchdog.handlers[i].name == name) {
+      handler = &watchdog.handlers[i];
+      break;
+    }
+  }
+  if (!handler && watchdog.num_handlers < WATCHDOG_MAX_HANDLERS) {
+    handler = &watchdog.handlers[watchdog.num_handlers++];
+    handler->name = name;
+  }
+
+  if (handler) {
+    handler->stalls++;
+    handler->total_nsec += dur_nsec;
+    handler->last_nsec = start_nsec;
+    if (dur_nsec > handler->max_nsec) {
+      handler->max_nsec = dur_nsec;
+    }
+  } else {
+    watchdog.untracked_stalls++;
+  }
+
+  wlr_log(WLR_INFO, "Event loop stalled for %.1fms in %s",
+          dur_nsec / (double)NSEC_PER_MSEC, name);
+  if (trace_enabled) {
+    trace_record(TRACE_SPAN, "stall", name, start_nsec, dur_nsec, NULL, 0);
+  }
+}
+
+static void watchdog_segment_end(int64_t now) {
+  int64_t dur = now - watchdog.segment_nsec;
+  if (dur > watchdog.threshold_nsec) {
+    watchdog_stall(watchdog.name, watchdog.segment_nsec, dur);
+  }
+}
+
+void watchdog_begin(char const *name) {
+  if (!watchdog_enabled) {
+    return;
+  }
+  watchdog.name = name;
+  watchdog.dispatch_nsec = watchdog.segment_nsec = get_time_nsec();
+}
+
+void watchdog_end(void) {
+  if (!watchdog_enabled || !watchdog.name) {
+    return;
+  }
+
+  int64_t now = get_time_nsec();
+  watchdog_segment_end(now);
+
+  int64_t dur = now - watchdog.dispatch_nsec;
+  watchdog.dispatches++;
+  if (dur > watchdog.threshold_nsec) {
+    watchdog.dispatch_stalls++;
+  }
+  if (dur > watchdog.dispatch_max_nsec) {
+    watchdog.dispatch_max_nsec = dur;
+  }
+  watchdog.name = NULL;
+}
+
+void watchdog_mark_handler(char const *name) {
+  /* Handlers called outside of a timed dispatch (e.g. at startup) */
+  if (!watchdog.name) {
+    return;
+  }
+
+  int64_t now = get_time_nsec();
+  watchdog_segment_end(now);
+  watchdog.name = name;
+  watchdog.segment_nsec = now;
+}
+
+void watchdog_print(FILE *f) {
+  if (!watchdog_enabled) {
+    return;
+  }
+
+  fprintf(f,
+          "event loop: %" PRIu64 " dispatches, %" PRIu64
+          " over %.1fms, longest %.1fms\n",
+          watchdog.dispatches, watchdog.dispatch_stalls,
+          watchdog.threshold_nsec / (double)NSEC_PER_MSEC,
+          watchdog.dispatch_max_nsec / (double)NSEC_PER_MSEC);
+
+  /* Worst offenders first, by their longest stall */
+  bool reported[WATCHDOG_MAX_HANDLERS] = {0};
+  for (size_t n = 0; n < WATCHDOG_REPORT_HANDLERS; n++) {
+    struct watchdog_handler const *worst = NULL;
+    size_t worst_idx = 0;
+    for (size_t i = 0; i < watchdog.num_handlers; i++) {
+      if (!reported[i] &&
+          (!worst || watchdog.handlers[i].max_nsec > worst->max_nsec)) {
+        worst = &watchdog.handlers[i];
+        worst_idx = i;
+      }
+    }
+    if (!worst) {
+      break;
+    }
+    reported[worst_idx] = true;
+
+    fprintf(f,
+            "  stall %s: %" PRIu64
+            " times, max %.1fms, total %.1fms, last %.1fs ago\n",
+            worst->name, worst->stalls, worst->max_nsec / (double)NSEC_PER_MSEC,
+            worst->total_nsec / (double)NSEC_PER_MSEC,
+            (get_time_nsec() - worst->last_nsec) / (double)NSEC_PER_SEC);
+  }
+  if (watchdog.untracked_stalls) {
+    fprintf(f, "  stall (other handlers): %" PRIu64 " times\n",
+            watchdog.untracked_stalls);
+  }
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2025 Joshua Watt
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Event loop stall detector. Every dispatch of the event loop is split into
+ * segments at each handler entry (every listener marks itself through
+ * get_type_ptr()), and a segment that runs longer than the threshold is
+ * charged to the handler that started it. Time spent after a nested handler
+ * returns is charged to the nested handler, so attribution is to the most
+ * recently entered handler.
+ *
+ * Handler names must be string literals, since only the pointers are kept.
+ */
+
+#define WATCHDOG_DEFAULT_THRESHOLD_MSEC (10)
+
+extern bool watchdog_enabled;
+
+void watchdog_init(int64_t threshold_nsec);
+void watchdog_begin(char const *name);
+void watchdog_end(void);
+void watchdog_mark_handler(char const *name);
+void watchdog_print(FILE *f);
+
+static inline void watchdog_mark(char const *name) {
+  if (__builtin_expect(!watchdog_enabled, 0)) {
+    return;
+  }
+  watchdog_mark_handler(name);
+}
+
+#endif